@@ -5,6 +5,7 @@ import (
 	"log"
 	"os"
 	"regexp"
+	"sort"
 	"strconv"
 	"strings"
 	"time"
@@ -21,13 +22,21 @@ const (
 	maxInputLen = cmdWidth - 3
 
 	statusLines = 5
+
+	threadsY = boxHeight + cmdHeight + statusLines + 2
 )
 
+var threadStatGroups = []string{
+	"threadTimeMean", "threadTimeMax", "threadTimeP99", "threadJitter", "threadMisses",
+}
+
 type Cli struct {
-	in     <-chan BoundVar
-	out    chan<- []BoundVar
-	status chan string
-	sync   chan bool
+	in      <-chan BoundVar
+	out     chan<- []BoundVar
+	status  chan string
+	sync    chan bool
+	journal chan<- bool
+	history chan<- *Var
 
 	vars map[string]map[string]BoundVar
 
@@ -35,13 +44,17 @@ type Cli struct {
 	lastGroup, lastName string
 }
 
-func NewCli(in <-chan BoundVar, out chan<- []BoundVar, status chan string) *Cli {
+func NewCli(in <-chan BoundVar, out chan<- []BoundVar, status chan string,
+	journal chan<- bool, history chan<- *Var) *Cli {
+
 	this := &Cli{
-		in:     in,
-		out:    out,
-		status: status,
-		sync:   make(chan bool),
-		vars:   make(map[string]map[string]BoundVar),
+		in:      in,
+		out:     out,
+		status:  status,
+		sync:    make(chan bool),
+		journal: journal,
+		history: history,
+		vars:    make(map[string]map[string]BoundVar),
 	}
 
 	this.addShmGroup("placement")
@@ -53,6 +66,9 @@ func NewCli(in <-chan BoundVar, out chan<- []BoundVar, status chan string) *Cli
 	this.addShmVar("pitchConf", "enabled")
 	this.addShmVar("rollConf", "enabled")
 	this.addShmGroup("power")
+	for _, g := range threadStatGroups {
+		this.addShmGroup(g)
+	}
 
 	return this
 }
@@ -97,6 +113,19 @@ var cliShortcuts = map[string]BoundVar{
 var cliFuncs = map[string]func(this *Cli){
 	"se": func(this *Cli) { this.sync <- true },
 	"sd": func(this *Cli) { this.sync <- false },
+
+	// Saves the drone's journal, which stops it recording
+	"jd": func(this *Cli) { this.journal <- true },
+
+	// Saves the last few seconds the drone keeps of the last var named
+	"hf": func(this *Cli) {
+		v, err := BindVar(this.lastGroup, this.lastName, nil)
+		if err != nil {
+			this.status <- err.Error()
+			return
+		}
+		this.history <- v.Var
+	},
 }
 
 func (this *Cli) Start() {
@@ -126,6 +155,7 @@ func (this *Cli) run() {
 	this.drawCommand()
 	this.drawVars()
 	this.drawQuickView(sync)
+	this.drawThreads()
 
 	for {
 		select {
@@ -147,6 +177,7 @@ func (this *Cli) run() {
 			if needRedraw {
 				this.drawVars()
 				this.drawQuickView(sync)
+				this.drawThreads()
 				needRedraw = false
 			}
 
@@ -330,6 +361,32 @@ func (this *Cli) drawQuickView(sync bool) {
 	ui.Render(qv)
 }
 
+// Loop health of every thread, in microseconds over the drone's last second
+func (this *Cli) drawThreads() {
+	names := make([]string, 0, len(Shm["threadMisses"]))
+	for name := range Shm["threadMisses"] {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+
+	const rowFormat = "%-12s%10v%10v%10v%10v%10v"
+	ls := ui.NewList()
+	ls.Items = []string{fmt.Sprintf(rowFormat, "", "MEAN", "MAX", "P99", "JITTER", "MISSES")}
+	for _, name := range names {
+		row := []interface{}{name}
+		for _, g := range threadStatGroups {
+			row = append(row, this.vars[g][name].ValueString())
+		}
+		ls.Items = append(ls.Items, fmt.Sprintf(rowFormat, row...))
+	}
+
+	ls.BorderLabel = "threads"
+	ls.X, ls.Y = 0, threadsY
+	ls.Width, ls.Height = cmdWidth, len(ls.Items)+2
+
+	ui.Render(ls)
+}
+
 func (this *Cli) drawCommand() {
 	const cursor = "[ ](bg-white)"
 
@@ -1,26 +1,70 @@
 package client
 
 import (
+	"encoding/binary"
 	"fmt"
 	"log"
 	"math"
+	"os"
+	"sort"
+	"time"
 
 	"github.com/alexozer/jankdrone/shm"
 	"github.com/golang/protobuf/proto"
 )
 
+const handshakePeriod = time.Second
+
+// Values in one values message; see shm.options. Range reads are capped at
+// the same, so each is answered with a single message.
+const maxRangeValues = 12
+
+// The buckets of the historied var with tag which start after since
+type historyRequest struct {
+	tag   int32
+	since uint32
+}
+
 type Sender struct {
 	varsIn  <-chan []BoundVar
 	varsOut chan<- BoundVar
 	status  chan string
 
+	// Whether the drone answered a handshake with our schema, from read to
+	// write. Until it has, our tags may mean other vars to it, so nothing
+	// is sent or received but handshakes.
+	verified chan bool
+
+	// Whether the drone answered with a different schema, from read to write.
+	// Handshaking again won't help until we're rebuilt, and would only
+	// bother the drone, so write stops sending anything until the link is
+	// swapped for another.
+	mismatched chan bool
+
+	// Requests for the next chunk of the drone's journal, from the cli to
+	// start draining and from read to continue
+	journal chan bool
+
+	// Vars to fetch the history of, from the cli
+	history <-chan *Var
+
+	// Requests for the next chunk of a var's history, from read
+	historyNext chan historyRequest
+
 	handheld, drone *Serial
 }
 
-func NewSender(varsIn <-chan []BoundVar, varsOut chan<- BoundVar, status chan string) *Sender {
+func NewSender(varsIn <-chan []BoundVar, varsOut chan<- BoundVar, status chan string,
+	journal chan bool, history <-chan *Var) *Sender {
+
 	return &Sender{
 		varsIn, varsOut,
 		status,
+		make(chan bool),
+		make(chan bool),
+		journal,
+		history,
+		make(chan historyRequest, 1),
 		NewSerial("/dev/ttyUSB0", 115200, status),
 		NewSerial("/dev/ttyACM0", 115200, status),
 	}
@@ -65,56 +109,263 @@ func (this *Sender) Start() {
 
 func (this *Sender) write(encodedOutChan chan chan [][]byte) {
 	encodedOut := <-encodedOutChan
+	verified, mismatched := false, false
+	handshake := time.NewTicker(handshakePeriod)
+	defer handshake.Stop()
+
 	for {
 		select {
 		case encodedOut = <-encodedOutChan:
+			mismatched = false
+		case verified = <-this.verified:
+		case mismatched = <-this.mismatched:
+			if mismatched {
+				verified = false
+			}
+		case <-handshake.C:
+			if mismatched {
+				continue
+			}
+			var tag int32
+			msg := &shm.ShmMsg{Tag: &tag, Value: &shm.ShmMsg_SchemaHash{SchemaHash: SchemaHash}}
+			if framed := this.frame(msg); framed != nil {
+				encodedOut <- [][]byte{framed}
+			}
+		case <-this.journal:
+			if !verified {
+				this.status <- "Not draining the journal until the drone's schema matches"
+				continue
+			}
+			var tag int32
+			msg := &shm.ShmMsg{Tag: &tag, Value: &shm.ShmMsg_Journal{Journal: []byte{}}}
+			if framed := this.frame(msg); framed != nil {
+				encodedOut <- [][]byte{framed}
+			}
+		case v := <-this.history:
+			if !verified {
+				this.status <- "Not fetching history until the drone's schema matches"
+				continue
+			}
+			this.requestHistory(encodedOut, historyRequest{int32(v.Tag), 0})
+		case req := <-this.historyNext:
+			if verified {
+				this.requestHistory(encodedOut, req)
+			}
 		case varSlice := <-this.varsIn:
+			if !verified {
+				this.status <- "Not sending until the drone's schema matches"
+				continue
+			}
 
 			var out [][]byte
-			for _, v := range varSlice {
-				msg := new(shm.ShmMsg)
-				newTag := int32(v.Tag)
-				msg.Tag = &newTag
-
-				if v.Value != nil {
-					switch value := v.Value.(type) {
-					case int:
-						msg.Value = &shm.ShmMsg_IntValue{IntValue: int32(value)}
-					case float64:
-						msg.Value = &shm.ShmMsg_FloatValue{FloatValue: float32(value)}
-					case bool:
-						msg.Value = &shm.ShmMsg_BoolValue{BoolValue: value}
-					default:
-						log.Fatal("Unexpected shm variable type")
-					}
+			for _, msg := range rangeMsgs(varSlice) {
+				if framed := this.frame(msg); framed != nil {
+					out = append(out, framed)
 				}
-
-				encodedVar, err := proto.Marshal(msg)
-				if err != nil {
-					log.Fatal("Failed to encode shm message:", err)
-				}
-				if len(encodedVar) > math.MaxUint8 {
-					this.status <- "Failed to send encoded variable; length too long"
-					continue
-				}
-				framedVar := append([]byte{byte(len(encodedVar))}, encodedVar...)
-				out = append(out, framedVar)
 			}
 
-			sz := 0
-			for _, s := range out {
-				sz += len(s)
-			}
 			encodedOut <- out
 		}
 	}
 }
 
+func (this *Sender) requestHistory(encodedOut chan<- [][]byte, req historyRequest) {
+	msg := &shm.ShmMsg{Tag: &req.tag, Value: &shm.ShmMsg_HistoryRequest{HistoryRequest: req.since}}
+	if framed := this.frame(msg); framed != nil {
+		encodedOut <- [][]byte{framed}
+	}
+}
+
+// Makes messages for reads and writes of vars, packing runs of consecutive
+// tags into range reads and values messages, so syncing a group takes one
+// request and about one reply instead of one of each per var
+func rangeMsgs(vars []BoundVar) []*shm.ShmMsg {
+	sorted := append([]BoundVar(nil), vars...)
+	sort.SliceStable(sorted, func(i, j int) bool { return sorted[i].Tag < sorted[j].Tag })
+
+	var msgs []*shm.ShmMsg
+	for start := 0; start < len(sorted); {
+		read := sorted[start].Value == nil
+		end := start + 1
+		for end < len(sorted) && sorted[end].Tag == sorted[end-1].Tag+1 &&
+			(sorted[end].Value == nil) == read && end-start < maxRangeValues {
+			end++
+		}
+
+		tag := int32(sorted[start].Tag)
+		msg := &shm.ShmMsg{Tag: &tag}
+		switch {
+		case end-start == 1:
+			setValue(msg, sorted[start].Value)
+		case read:
+			msg.Value = &shm.ShmMsg_RangeRead{RangeRead: uint32(end - start)}
+		default:
+			values := &shm.ShmValues{}
+			for _, v := range sorted[start:end] {
+				values.Values = append(values.Values, packValue(v.Value))
+			}
+			msg.Value = &shm.ShmMsg_Values{Values: values}
+		}
+		msgs = append(msgs, msg)
+		start = end
+	}
+	return msgs
+}
+
+// Sets the value of a message for one var, leaving it unset to read it
+func setValue(msg *shm.ShmMsg, value interface{}) {
+	switch value := value.(type) {
+	case nil:
+	case int:
+		msg.Value = &shm.ShmMsg_IntValue{IntValue: int32(value)}
+	case float64:
+		msg.Value = &shm.ShmMsg_FloatValue{FloatValue: float32(value)}
+	case bool:
+		msg.Value = &shm.ShmMsg_BoolValue{BoolValue: value}
+	default:
+		log.Fatal("Unexpected shm variable type")
+	}
+}
+
+// As in ShmValues, the bits of an int or float, or 0 or 1 for a bool
+func packValue(value interface{}) uint32 {
+	switch value := value.(type) {
+	case int:
+		return uint32(int32(value))
+	case float64:
+		return math.Float32bits(float32(value))
+	case bool:
+		if value {
+			return 1
+		}
+		return 0
+	default:
+		log.Fatal("Unexpected shm variable type")
+		return 0
+	}
+}
+
+func unpackValue(v *Var, bits uint32) interface{} {
+	switch v.DefaultValue.(type) {
+	case int:
+		return int(int32(bits))
+	case float64:
+		return float64(math.Float32frombits(bits))
+	case bool:
+		return bits != 0
+	default:
+		return nil
+	}
+}
+
+// Appends a chunk of the drone's journal to the file being saved, creating it
+// if needed, and asks for the next. Returns the file, or nil once the drone
+// has nothing left and it's closed.
+func (this *Sender) saveJournal(journal *os.File, chunk []byte) *os.File {
+	if len(chunk) == 0 {
+		if journal == nil {
+			this.status <- "The drone's journal is empty"
+			return nil
+		}
+		info, _ := journal.Stat()
+		journal.Close()
+		this.status <- fmt.Sprintf("Saved journal to %s, %d bytes", journal.Name(), info.Size())
+		return nil
+	}
+
+	if journal == nil {
+		var err error
+		journal, err = os.Create(time.Now().Format("journal-20060102-150405.bin"))
+		if err != nil {
+			this.status <- fmt.Sprint("Failed to save journal:", err)
+			return nil
+		}
+
+		// Which replay checks against its schema
+		header := []byte("SHMJ\x00\x00\x00\x00")
+		binary.LittleEndian.PutUint32(header[4:], SchemaHash)
+		journal.Write(header)
+	}
+
+	if _, err := journal.Write(chunk); err != nil {
+		this.status <- fmt.Sprint("Failed to save journal:", err)
+		journal.Close()
+		return nil
+	}
+	this.journal <- true
+	return journal
+}
+
+// Appends a chunk of a var's history to a CSV file, creating it if needed,
+// and asks for the chunk after it. Returns the file, or nil once the drone
+// has sent them all and it's closed.
+func (this *Sender) saveHistory(file *os.File, tag int32, chunk *shm.ShmHistory) *os.File {
+	v, err := BindVarTag(int(tag), nil)
+	if err != nil {
+		this.status <- fmt.Sprint("Failed to bind history var:", err)
+		return file
+	}
+
+	if len(chunk.Time) == 0 {
+		if file == nil {
+			this.status <- fmt.Sprintf("The drone has no history of %s.%s", v.Group, v.Name)
+			return nil
+		}
+		file.Close()
+		this.status <- fmt.Sprintf("Saved history of %s.%s to %s", v.Group, v.Name, file.Name())
+		return nil
+	}
+
+	if file == nil {
+		file, err = os.Create(fmt.Sprintf("history-%s.%s-%s.csv",
+			v.Group, v.Name, time.Now().Format("20060102-150405")))
+		if err != nil {
+			this.status <- fmt.Sprint("Failed to save history:", err)
+			return nil
+		}
+		fmt.Fprintln(file, "micros,min,max")
+	}
+
+	for i := range chunk.Time {
+		if i >= len(chunk.Min) || i >= len(chunk.Max) {
+			break
+		}
+		fmt.Fprintf(file, "%d,%g,%g\n", chunk.Time[i], chunk.Min[i], chunk.Max[i])
+	}
+	this.historyNext <- historyRequest{tag, chunk.Time[len(chunk.Time)-1]}
+	return file
+}
+
+// Encodes a message with its length in front, or returns nil if too long
+func (this *Sender) frame(msg *shm.ShmMsg) []byte {
+	encodedVar, err := proto.Marshal(msg)
+	if err != nil {
+		log.Fatal("Failed to encode shm message:", err)
+	}
+	if len(encodedVar) > math.MaxUint8 {
+		this.status <- "Failed to send encoded variable; length too long"
+		return nil
+	}
+	return append([]byte{byte(len(encodedVar))}, encodedVar...)
+}
+
 func (this *Sender) read(encodedInChan chan chan []byte) {
 	encodedIn := <-encodedInChan
+	verified, mismatched := false, false
+	var journal *os.File
+	histories := make(map[int32]*os.File)
 	for {
 		select {
 		case encodedIn = <-encodedInChan:
+			// A different drone may be on the other end
+			if verified {
+				verified = false
+				this.verified <- verified
+			}
+			if mismatched {
+				mismatched = false
+				this.mismatched <- mismatched
+			}
 		case encodedVar := <-encodedIn:
 			for len(encodedVar) > 0 {
 				shmMsg := new(shm.ShmMsg)
@@ -127,6 +378,58 @@ func (this *Sender) read(encodedInChan chan chan []byte) {
 					break
 				}
 
+				if hash, ok := shmMsg.Value.(*shm.ShmMsg_SchemaHash); ok {
+					matches := hash.SchemaHash == SchemaHash
+					if !matches && !mismatched {
+						this.status <- fmt.Sprintf("Drone schema hash %08x doesn't match ours, %08x; "+
+							"regenerate shm and rebuild", hash.SchemaHash, SchemaHash)
+						verified, mismatched = false, true
+						this.mismatched <- mismatched
+					} else if matches {
+						if mismatched {
+							mismatched = false
+							this.mismatched <- mismatched
+						}
+						if !verified {
+							verified = true
+							this.verified <- verified
+						}
+					}
+					encodedVar = encodedVar[encodedVar[0]+1:]
+					continue
+				}
+				if !verified {
+					encodedVar = encodedVar[encodedVar[0]+1:]
+					continue
+				}
+
+				if chunk, ok := shmMsg.Value.(*shm.ShmMsg_Journal); ok {
+					journal = this.saveJournal(journal, chunk.Journal)
+					encodedVar = encodedVar[encodedVar[0]+1:]
+					continue
+				}
+
+				if values, ok := shmMsg.Value.(*shm.ShmMsg_Values); ok {
+					for i, bits := range values.Values.Values {
+						v, err := BindVarTag(int(*shmMsg.Tag)+i, nil)
+						if err != nil {
+							this.status <- fmt.Sprint("Failed to bind remote var:", err)
+							break
+						}
+						v.Value = unpackValue(v.Var, bits)
+						this.varsOut <- v
+					}
+					encodedVar = encodedVar[encodedVar[0]+1:]
+					continue
+				}
+
+				if chunk, ok := shmMsg.Value.(*shm.ShmMsg_History); ok {
+					tag := *shmMsg.Tag
+					histories[tag] = this.saveHistory(histories[tag], tag, chunk.History)
+					encodedVar = encodedVar[encodedVar[0]+1:]
+					continue
+				}
+
 				var outValue interface{}
 				switch inValue := shmMsg.Value.(type) {
 				case *shm.ShmMsg_IntValue:
@@ -0,0 +1,15 @@
+# Prints section sizes and the largest symbols in RAM after linking the
+# ramreport environment
+
+Import("env")
+
+
+def report(source, target, env):
+    elf = str(target[0])
+    env.Execute("arm-none-eabi-size -A %s" % elf)
+    print("Largest RAM symbols:")
+    env.Execute("arm-none-eabi-nm -C -S --size-sort -r %s "
+                "| grep -i ' [bd] ' | head -n 20" % elf)
+
+
+env.AddPostAction("$BUILD_DIR/firmware.elf", report)
@@ -6,18 +6,24 @@ Altimeter::Altimeter(): m_groundAltitude{0} {
 	m_sensor.setModeAltimeter();
 	m_sensor.setOversampleRate(7); // Set Oversample to the recommended 128
 	m_sensor.enableEventFlags(); // Enable all three pressure and temp event flags 
-	shm().switches.calibrateAltimeter = true;
+	ShmVars::switches::calibrateAltimeter.set(true);
 }
 
-void Altimeter::operator()() {
+Coroutine::Status Altimeter::operator()() {
+	CO_BEGIN(m_co);
+
 	if (shm().switches.calibrateAltimeter) {
+		// read() would busy-wait for the conversion, so wait for it here
+		CO_AWAIT(m_co, m_sensor.available(), POLL_MICROS);
 		m_sensor.read();
 		m_groundAltitude = m_sensor.altitude();
-		shm().switches.calibrateAltimeter = false;
+		ShmVars::switches::calibrateAltimeter.set(false);
 
 	} else if (m_sensor.available()) {
 		m_sensor.read();
-		shm().placement.z = m_sensor.altitude() - m_groundAltitude;
-		shm().temperature.altimeter = m_sensor.temp();
+		ShmVars::placement::z.set(m_sensor.altitude() - m_groundAltitude);
+		ShmVars::temperature::altimeter.set(m_sensor.temp());
 	}
+
+	CO_END(m_co);
 }
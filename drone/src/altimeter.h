@@ -1,13 +1,18 @@
 #pragma once
 
 #include <SparkFunMPL3115A2.h>
+#include "coroutine.h"
 
 class Altimeter {
 	public:
 		Altimeter();
-		void operator()();
+		Coroutine::Status operator()();
 
 	private:
+		// How often to check for a conversion while calibrating
+		static constexpr unsigned long POLL_MICROS = 10000;
+
 		MPL3115A2 m_sensor;
 		float m_groundAltitude;
+		Coroutine m_co;
 };
@@ -0,0 +1,158 @@
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "log.h"
+#include "shm.h"
+#include "thread.h"
+#include "benchmark.h"
+
+namespace {
+
+constexpr int PASSES = 100000;
+
+volatile int runs;
+
+void work() { runs++; }
+
+// The thread loop as it was before the scheduler: each thread wraps its body
+// in a std::function and checks the clock itself, and every pass visits
+// every thread in declaration order
+class LegacyThread {
+	public:
+		LegacyThread(std::function<void()> func, unsigned long intervalMicros):
+			m_func{func}, m_interval{intervalMicros}, m_hasRun{false} {}
+
+		void operator()() {
+			auto t = micros();
+			if (!m_hasRun || t - m_lastTime >= m_interval) {
+				m_func();
+				m_hasRun = true;
+				m_lastTime = t;
+			}
+		}
+
+	private:
+		std::function<void()> m_func;
+		unsigned long m_interval;
+		unsigned long m_lastTime;
+		bool m_hasRun;
+};
+
+class LegacyFuncSet {
+	public:
+		LegacyFuncSet(std::initializer_list<std::function<void()>> funcs):
+			m_funcs{funcs} {}
+
+		void operator()() {
+			for (auto& f : m_funcs) f();
+		}
+
+	private:
+		std::vector<std::function<void()>> m_funcs;
+};
+
+struct Work {
+	void operator()() { work(); }
+} workObject;
+
+// Average cost of a pass, or of a run if any threads ran, in nanoseconds
+template <typename Loop>
+int nanosPer(Loop& loop) {
+	int startRuns = runs;
+	auto start = micros();
+	for (int i = 0; i < PASSES; i++) loop();
+	auto elapsed = micros() - start;
+
+	int count = runs - startRuns;
+	return elapsed * 1000ull / (count ? count : PASSES);
+}
+
+// Eight threads like main.cpp, all either due on every pass or never due. The
+// scheduler runs one thread per pass where the legacy loop runs them all, so
+// compare the cost per run when threads are due.
+void benchmark(unsigned long interval, const char* description) {
+	LegacyFuncSet legacy{
+		LegacyThread([&] { workObject(); }, interval),
+		LegacyThread([&] { workObject(); }, interval),
+		LegacyThread([&] { workObject(); }, interval),
+		LegacyThread([&] { workObject(); }, interval),
+		LegacyThread([&] { workObject(); }, interval),
+		LegacyThread([&] { workObject(); }, interval),
+		LegacyThread(&work, interval),
+		LegacyThread(&work, interval),
+	};
+
+	Scheduler<
+		Task<Work&>, Task<Work&>, Task<Work&>, Task<Work&>,
+		Task<Work&>, Task<Work&>,
+		Task<Func<&work>>, Task<Func<&work>>
+	> scheduler{
+		{"a", workObject, Thread::Criticality::FLIGHT, interval},
+		{"b", workObject, Thread::Criticality::FLIGHT, interval},
+		{"c", workObject, Thread::Criticality::FLIGHT, interval},
+		{"d", workObject, Thread::Criticality::FLIGHT, interval},
+		{"e", workObject, Thread::Criticality::FLIGHT, interval},
+		{"f", workObject, Thread::Criticality::FLIGHT, interval},
+		{"g", {}, Thread::Criticality::FLIGHT, interval},
+		{"h", {}, Thread::Criticality::FLIGHT, interval},
+	};
+
+	// Get the first run of every thread out of the way
+	legacy();
+	for (size_t i = 0; i < scheduler.SIZE; i++) scheduler.poll();
+
+	// Polled rather than called, which would sleep when nothing is due
+	auto pass = [&] { scheduler.poll(); };
+	int legacyNanos = nanosPer(legacy);
+	int schedulerNanos = nanosPer(pass);
+	Log::info("%s: legacy %d ns, scheduler %d ns",
+			description, legacyNanos, schedulerNanos);
+}
+
+// Average nanoseconds per call of f over PASSES
+template <typename F>
+int nanosPerCall(F f) {
+	auto start = micros();
+	for (int i = 0; i < PASSES; i++) f();
+	return (micros() - start) * 1000ull / PASSES;
+}
+
+volatile float sink;
+
+} // namespace
+
+void benchmarkShmSnapshot() {
+	Log::info("Benchmarking placement snapshots over %d passes...", PASSES);
+	auto& placement = shm().placement;
+
+	int directRead = nanosPerCall([&] {
+		sink = placement.yaw + placement.pitch + placement.roll + placement.z
+			+ placement.yawVel + placement.pitchVel + placement.rollVel
+			+ placement.zVel;
+	});
+	int snapshotRead = nanosPerCall([&] {
+		auto p = placement.snapshot();
+		sink = p.yaw + p.pitch + p.roll + p.z
+			+ p.yawVel + p.pitchVel + p.rollVel + p.zVel;
+	});
+	Log::info("Read 8 vars: direct %d ns, snapshot %d ns", directRead, snapshotRead);
+
+	float value = sink;
+	int directWrite = nanosPerCall([&] {
+		placement.yaw = value; placement.pitch = value; placement.roll = value;
+		placement.yawVel = value; placement.pitchVel = value; placement.rollVel = value;
+	});
+	int sequencedWrite = nanosPerCall([&] {
+		placement.write([&](Shm::Group_placement::Values& p) {
+			p.yaw = value; p.pitch = value; p.roll = value;
+			p.yawVel = value; p.pitchVel = value; p.rollVel = value;
+		});
+	});
+	Log::info("Write 6 vars: direct %d ns, sequenced %d ns", directWrite, sequencedWrite);
+}
+
+void benchmarkScheduler() {
+	Log::info("Benchmarking scheduler overhead over %d passes...", PASSES);
+	benchmark(Thread::SECOND * 1000, "Idle pass");
+	benchmark(0, "Run with every thread due");
+}
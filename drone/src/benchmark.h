@@ -0,0 +1,12 @@
+#pragma once
+
+// Compares the per-pass overhead of the previous round-robin std::function
+// thread loop with the current statically dispatched scheduler, and logs the
+// results. Build with -DBENCHMARK_SCHEDULER (the benchmark environment) to run
+// it at startup.
+void benchmarkScheduler();
+
+// Compares reading the placement group directly with taking a snapshot, and
+// writing it directly with writing through its sequence counter. Run with the
+// scheduler benchmark.
+void benchmarkShmSnapshot();
@@ -22,8 +22,7 @@ constexpr bool THRUSTER0_CCW = true;
 constexpr int THRUSTER_PINS[] = {22, 4, 5, 6, 23, 3},
 		  NUM_THRUSTERS = sizeof(THRUSTER_PINS) / sizeof(THRUSTER_PINS[0]),
 		  MIN_ESC_PULSE = 700,
-		  MAX_ESC_PULSE = 2000,
-		  ESCS_CALIBRATED_ADDRESS = 0;
+		  MAX_ESC_PULSE = 2000;
 
 constexpr int RADIO_NETWORK_ID = 100,
 		  RADIO_NODE_ID = 1,
@@ -50,9 +49,7 @@ constexpr bool OFFSET_YAW = false,
 		  NEGATE_PITCH = true,
 		  NEGATE_ROLL = true;
 
-constexpr int IMU_INT_PIN = 8,
-		  IMU_CALIBRATED_ADDRESS = 1,
-		  IMU_CALIBRATION_ADDRESS = 2;
+constexpr int IMU_INT_PIN = 8;
 
 constexpr int VOLTAGE_PIN = 14,
 		  BATTERY_CELLS = 3;
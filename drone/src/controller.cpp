@@ -3,25 +3,32 @@
 #include "log.h"
 #include "controller.h"
 
+// Handles for an axis's settings, desires and output, and its placement in
+// the controller's snapshot
+#define AXIS_VARS(axis) \
+	ShmVars::axis##Conf::enabled, \
+	ShmVars::axis##Conf::p, ShmVars::axis##Conf::i, ShmVars::axis##Conf::d, \
+	&m_placement.axis, &m_placement.axis##Vel, \
+	ShmVars::desires::axis, ShmVars::desires::axis##Vel, \
+	ShmVars::controllerOut::axis
+
 Controller::Controller():
-	m_enabledBefore{shm().var("controller.enabled")->get<bool>()}, 
+	m_enabledBefore{ShmVars::controller::enabled.get()},
 	m_lastTime{0},
 
-	m_yawControl{"yaw"},
-	m_pitchControl{"pitch"},
-	m_rollControl{"roll"},
-	m_zControl{"z", false}
+	m_yawControl{AXIS_VARS(yaw)},
+	m_pitchControl{AXIS_VARS(pitch)},
+	m_rollControl{AXIS_VARS(roll)},
+	m_zControl{AXIS_VARS(z), false}
 {
 	initThrusters();
 	checkTorqueIndependence();
 }
 
-void Controller::initThrusters() {
-	auto thrustersArray = shm().thrusters.array("t");
-	for (int i = 0; i < NUM_THRUSTERS; i++) {
-		m_thrusters[i].shm = thrustersArray[i]->ptr<float>();
-	}
+static_assert(ShmVars::thrusters::t.size() >= NUM_THRUSTERS,
+		"Not enough thrusters in shm");
 
+void Controller::initThrusters() {
 	float totalPitchTorque = 0, totalRollTorque = 0;
 	for (int i = 0; i < NUM_THRUSTERS; i++) {
 		auto& t = m_thrusters[i];
@@ -103,8 +110,8 @@ void Controller::operator()() {
 
 	} else {
 		if (m_enabledBefore) {
-			for (auto v : shm().thrusters.vars()) {
-				v->set(0);
+			for (int i = 0; i < NUM_THRUSTERS; i++) {
+				ShmVars::thrusters::t[i].set(0);
 			}
 
 			m_enabledBefore = false;
@@ -114,48 +121,52 @@ void Controller::operator()() {
 	}
 
 	float dt = (float)(time - m_lastTime) / 1e6;
+	m_placement = shm().placement.snapshot();
 	float yawOut = m_yawControl.out(dt);
 	float pitchOut = m_pitchControl.out(dt);
 	float rollOut = m_rollControl.out(dt);
-	for (auto& t : m_thrusters) {
-		*t.shm = t.force.thrustPerTotalValue * shm().desires.force
+	for (int i = 0; i < NUM_THRUSTERS; i++) {
+		auto& t = m_thrusters[i];
+		ShmVars::thrusters::t[i].set(t.force.thrustPerTotalValue * shm().desires.force
 			+ t.yaw.thrustPerTotalValue * yawOut
 			+ t.pitch.thrustPerTotalValue * pitchOut
-			+ t.roll.thrustPerTotalValue * rollOut;
+			+ t.roll.thrustPerTotalValue * rollOut);
 	}
 
 	m_lastTime = time;
 }
 
-Controller::AxisControl::AxisControl(std::string name, bool mod):
+Controller::AxisControl::AxisControl(Shm::Handle<bool> enabled,
+		Shm::Handle<float> p, Shm::Handle<float> i, Shm::Handle<float> d,
+		const float* current, const float* currentVel,
+		Shm::Handle<float> desire, Shm::Handle<float> velDesire,
+		Shm::Handle<float> out, bool mod):
 	m_mod{mod},
-	m_pid{angleDiff}
-{
-	auto settings = shm().group(name + "Conf");
-	m_enabled = settings->var("enabled")->ptr<bool>();
-	m_p = settings->var("p")->ptr<float>();
-	m_i = settings->var("i")->ptr<float>();
-	m_d = settings->var("d")->ptr<float>();
-	m_current = shm().placement.var(name)->ptr<float>();
-	m_currentVel = shm().placement.var(name + "Vel")->ptr<float>();
-	m_desire = shm().desires.var(name)->ptr<float>();
-	m_velDesire = shm().desires.var(name + "Vel")->ptr<float>();
-	m_out = shm().controllerOut.var(name)->ptr<float>();
-}
+	m_enabled{enabled.ptr()},
+	m_current{current},
+	m_currentVel{currentVel},
+	m_velDesire{velDesire.ptr()},
+	m_p{p.ptr()},
+	m_i{i.ptr()},
+	m_d{d.ptr()},
+	m_desire{desire},
+	m_out{out},
+	m_pid{angleDiff} {}
 
 float Controller::AxisControl::out(float dt) {
 	if (*m_enabled) {
-		*m_desire += dt * *m_velDesire;
-		if (m_mod) *m_desire = splitFmod(*m_desire, 360);
+		float desire = m_desire.get() + dt * *m_velDesire;
+		if (m_mod) desire = splitFmod(desire, 360);
+		m_desire.set(desire);
 
-		*m_out = m_pid(dt, 
-				*m_current, *m_currentVel, *m_desire,
-				*m_p, *m_i, *m_d);
+		m_out.set(m_pid(dt, 
+				*m_current, *m_currentVel, desire,
+				*m_p, *m_i, *m_d));
 	} else {
-		*m_out = 0;
+		m_out.set(0);
 	}
 
-	return *m_out;
+	return m_out.get();
 }
 
 void Controller::AxisControl::reset() {
@@ -17,28 +17,37 @@ class Controller {
 			float valuePerThrust;
 		};
 
+		// Mixing for the thruster of the same index in shm
 		struct Thruster {
 			ThrusterAxis force, yaw, pitch, roll;
-			float* shm;
 		};
 
 		class AxisControl {
 			public:
-				AxisControl(std::string name, bool mod = true);
+				AxisControl(Shm::Handle<bool> enabled,
+						Shm::Handle<float> p, Shm::Handle<float> i, Shm::Handle<float> d,
+						const float* current, const float* currentVel,
+						Shm::Handle<float> desire, Shm::Handle<float> velDesire,
+						Shm::Handle<float> out, bool mod = true);
 				float out(float dt);
 				void reset();
 
 			private:
 				bool m_mod;
 				bool* m_enabled;
-				float *m_current, *m_currentVel, 
-					  *m_desire, *m_velDesire, *m_out,
-					  *m_p, *m_i, *m_d;
+				const float *m_current, *m_currentVel;
+				float *m_velDesire, *m_p, *m_i, *m_d;
+
+				// Written through handles, so the journal sees them
+				Shm::Handle<float> m_desire, m_out;
 				PID m_pid;
 		};
 
 		bool m_enabledBefore;
 		unsigned long m_lastTime;
+
+		// Placement as of the start of this run, which axes read from
+		Shm::Group_placement::Values m_placement;
 		Thruster m_thrusters[NUM_THRUSTERS];
 		AxisControl m_yawControl, m_pitchControl, m_rollControl, m_zControl;
 
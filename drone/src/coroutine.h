@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+
+/* Stackless coroutines in the style of protothreads, so a thread can wait on a
+ * slow device without blocking the threads around it. A coroutine is a
+ * function returning Coroutine::Status whose body sits between CO_BEGIN and
+ * CO_END; each call resumes where the last one left off. When run by a Task,
+ * a suspended coroutine is resumed at the time it asks for rather than at its
+ * next interval.
+ *
+ * Locals don't survive a suspension, so keep state in members, and declare
+ * locals inside their own braces. The body can't contain switch statements.
+ */
+class Coroutine {
+	public:
+		// Result of a call: finished, or suspended until a time in micros
+		class Status {
+			public:
+				Status(): m_finished{true}, m_wakeTime{0} {}
+				Status(unsigned long wakeTime): m_finished{false}, m_wakeTime{wakeTime} {}
+
+				bool finished() const { return m_finished; }
+				unsigned long wakeTime() const { return m_wakeTime; }
+
+			private:
+				bool m_finished;
+				unsigned long m_wakeTime;
+		};
+
+		Coroutine(): m_line{0}, m_wakeTime{0} {}
+
+		// Is the coroutine partway through its body?
+		bool running() const { return m_line != 0; }
+
+		// Start from the top on the next call
+		void reset() { m_line = 0; }
+
+		// Only for the macros below
+		int m_line;
+		unsigned long m_wakeTime;
+};
+
+#define CO_BEGIN(co) switch ((co).m_line) { case 0:
+
+// Suspend until the next call, asking to be resumed as soon as possible
+#define CO_YIELD(co) \
+	do { \
+		(co).m_line = __LINE__; \
+		return Coroutine::Status{micros()}; \
+		case __LINE__:; \
+	} while (0)
+
+// Suspend until a condition holds, checking it every poll period
+#define CO_AWAIT(co, condition, pollMicros) \
+	do { \
+		(co).m_line = __LINE__; \
+		case __LINE__: \
+		if (!(condition)) return Coroutine::Status{micros() + (pollMicros)}; \
+	} while (0)
+
+// Suspend for a duration, even if called again before it has passed
+#define CO_SLEEP(co, micros_) \
+	do { \
+		(co).m_wakeTime = micros() + (micros_); \
+		(co).m_line = __LINE__; \
+		case __LINE__: \
+		if ((long)(micros() - (co).m_wakeTime) < 0) { \
+			return Coroutine::Status{(co).m_wakeTime}; \
+		} \
+	} while (0)
+
+#define CO_END(co) } (co).m_line = 0; return Coroutine::Status{}
@@ -5,28 +5,40 @@
 #include "log.h"
 #include "deadman.h"
 
+Deadman::Deadman() {
+	ShmVars::deadman::enabled.subscribe(&check);
+	ShmVars::switches::softKill.subscribe(&check);
+	ShmVars::remote::connected.subscribe(&check);
+	ShmVars::power::critical.subscribe(&check);
+}
+
 void Deadman::operator()() {
 	if (!shm().deadman.enabled || shm().switches.softKill) return;
 
-	if (!shm().remote.connected) {
-		kill("remote disconnection");;
+	auto placement = shm().placement.snapshot();
+	float pitchTilt = fabs(angleDiff(placement.pitch, 0));
+	float rollTilt = fabs(angleDiff(placement.roll, 0));
+	if (fmax(pitchTilt, rollTilt) > shm().deadman.maxTilt) {
+		kill("extreme tilt");
 		return;
 	}
+}
 
-	if (shm().power.critical) {
-		kill("critically low power");
+void Deadman::check(void*, const Shm::Var*) {
+	if (!shm().deadman.enabled || shm().switches.softKill) return;
+
+	if (!shm().remote.connected) {
+		kill("remote disconnection");
 		return;
 	}
 
-	float pitchTilt = fabs(angleDiff(shm().placement.pitch, 0));
-	float rollTilt = fabs(angleDiff(shm().placement.roll, 0));
-	if (fmax(pitchTilt, rollTilt) > shm().deadman.maxTilt) {
-		kill("extreme tilt");
+	if (shm().power.critical) {
+		kill("critically low power");
 		return;
 	}
 }
 
-void Deadman::kill(std::string reason) {
-	shm().switches.softKill = true;
-	Log::warn("Softkilled by deadman due to %s", reason.c_str());
+void Deadman::kill(const char* reason) {
+	ShmVars::switches::softKill.set(true);
+	Log::warn("Softkilled by deadman due to %s", reason);
 }
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <string>
+#include "shm.h"
 
+// Kills on losing the remote or critical power as soon as either is set, and
+// polls for extreme tilt
 class Deadman {
 	public:
+		Deadman();
 		void operator()();
 
 	private:
-		void kill(std::string reason);
+		static void check(void* context, const Shm::Var* var);
+		static void kill(const char* reason);
 };
@@ -0,0 +1,75 @@
+#include <Arduino.h>
+#include <cmath>
+#include "log.h"
+#include "shm.h"
+#include "history.h"
+
+namespace {
+
+// At least one, so there are no empty arrays without historied vars
+constexpr int SIZE = Shm::NUM_HISTORIED > 0 ? Shm::NUM_HISTORIED : 1;
+
+// Tag of each historied var in tag order
+int tags[SIZE];
+
+// Rings of buckets, whose time is shared by every var
+uint32_t times[History::LENGTH];
+float mins[SIZE][History::LENGTH], maxes[SIZE][History::LENGTH];
+
+// The open bucket, with samples taken into it so far, follows the closed
+int open = 0, closed = 0, samples = 0;
+
+int indexOf(int tag) {
+	for (int i = 0; i < Shm::NUM_HISTORIED; i++) {
+		if (tags[i] == tag) return i;
+	}
+	return -1;
+}
+
+}
+
+History::History() {
+	int i = 0;
+	for (int tag = 0; tag < Shm::NUM_VARS; tag++) {
+		auto var = shm().var(tag);
+		if (!var->historied()) continue;
+
+		auto type = var->type();
+		if (type != Shm::Var::Type::INT && type != Shm::Var::Type::FLOAT) {
+			Log::fatal("Can't keep history of %s, which isn't an int or float",
+					var->path().c_str());
+		}
+		tags[i++] = tag;
+	}
+}
+
+void History::operator()() {
+	if (shm().switches.softKill) return;
+
+	if (samples == 0) times[open] = micros();
+	for (int i = 0; i < Shm::NUM_HISTORIED; i++) {
+		float value = shm().var(tags[i])->get<float>();
+		if (samples == 0) {
+			mins[i][open] = maxes[i][open] = value;
+		} else {
+			mins[i][open] = fmin(mins[i][open], value);
+			maxes[i][open] = fmax(maxes[i][open], value);
+		}
+	}
+
+	if (++samples == DECIMATION) {
+		samples = 0;
+		open = (open + 1) % LENGTH;
+		if (closed < LENGTH - 1) closed++;
+	}
+}
+
+int History::count(int tag) {
+	return indexOf(tag) < 0 ? -1 : closed;
+}
+
+History::Bucket History::bucket(int tag, int i) {
+	int index = indexOf(tag);
+	int slot = (open - closed + i + LENGTH) % LENGTH;
+	return {times[slot], mins[index][slot], maxes[index][slot]};
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+/* Keeps the last few seconds of the vars marked historied in shm.py, so a
+ * remote can look at what led up to a deadman kill without streaming them
+ * live. Each run samples every historied var, and every DECIMATION samples
+ * close a bucket holding the time of its first sample and the min and max of
+ * all of them, so short spikes survive. Sampling pauses while soft killed,
+ * which keeps the seconds before a kill until the drone is armed again.
+ */
+class History {
+	public:
+		static constexpr int LENGTH = 96, DECIMATION = 10;
+
+		struct Bucket {
+			uint32_t time;
+			float min, max;
+		};
+
+		History();
+
+		void operator()();
+
+		// Closed buckets of the var with tag, or -1 if it isn't historied
+		static int count(int tag);
+
+		// The ith oldest closed bucket of the var with tag
+		static Bucket bucket(int tag, int i);
+};
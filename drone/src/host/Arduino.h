@@ -0,0 +1,36 @@
+#pragma once
+
+// Just enough of the Arduino API to build the scheduler and shm on the host,
+// running on a virtual clock
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "virtual_clock.h"
+
+inline unsigned long micros() { return VirtualClock::now(); }
+inline unsigned long millis() { return VirtualClock::now() / 1000; }
+inline void delay(unsigned long ms) { VirtualClock::advance(ms * 1000); }
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Serial writes to stdout
+class HostSerial {
+	public:
+		void begin(unsigned long) {}
+
+		template <typename... Args>
+		void printf(const char* format, Args... args) {
+			std::printf(format, args...);
+		}
+
+		void print(const char* str) { std::fputs(str, stdout); }
+		void print(char c) { std::putchar(c); }
+		void print(int n) { std::printf("%d", n); }
+		void print(float n) { std::printf("%f", n); }
+		void println() { std::putchar('\n'); }
+};
+
+extern HostSerial Serial;
@@ -0,0 +1,109 @@
+#ifdef JOURNAL_REPLAY
+
+/* Replays a journal drained from the drone into the shm shared with other
+ * host processes, so shmtool or a plot can follow along; see journal.h and
+ * shm_posix.h.
+ *
+ *     pio run -e replay && .pio/build/replay/program journal.bin [-x speed]
+ *
+ * Writes are spaced as they were recorded, sped up by speed, or as fast as
+ * possible with a speed of 0. The file starts with "SHMJ" and the
+ * little-endian schema hash of the drone, which must match ours, as the
+ * client saves it.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <Arduino.h>
+#include "log.h"
+#include "shm.h"
+#include "journal.h"
+#include "shm_posix.h"
+
+HostSerial Serial;
+
+static uint32_t readLittleEndian(const uint8_t* bytes, int size) {
+	uint32_t value = 0;
+	for (int i = size - 1; i >= 0; i--) value = value << 8 | bytes[i];
+	return value;
+}
+
+static void apply(const Shm::Var* var, const uint8_t* value) {
+	uint32_t raw = readLittleEndian(value, 4);
+	switch (var->type()) {
+		case Shm::Var::Type::INT:
+			var->set((int)raw);
+			break;
+		case Shm::Var::Type::FLOAT: {
+			float f;
+			memcpy(&f, &raw, sizeof(f));
+			var->set(f);
+			break;
+		}
+		case Shm::Var::Type::BOOL:
+			var->set(value[0] != 0);
+			break;
+		case Shm::Var::Type::STRING:
+			break;
+	}
+}
+
+int main(int argc, char** argv) {
+	const char* path = nullptr;
+	float speed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-x" && i + 1 < argc) {
+			speed = std::atof(argv[++i]);
+		} else if (!path) {
+			path = argv[i];
+		} else {
+			Log::fatal("Expected a journal file and optionally -x speed, got %s", argv[i]);
+		}
+	}
+	if (!path) Log::fatal("Expected a journal file");
+
+	auto file = std::fopen(path, "rb");
+	if (!file) Log::fatal("Failed to open %s", path);
+
+	uint8_t header[8];
+	if (std::fread(header, 1, sizeof(header), file) != sizeof(header)
+			|| memcmp(header, "SHMJ", 4) != 0) {
+		Log::fatal("%s isn't a journal", path);
+	}
+	uint32_t schemaHash = readLittleEndian(header + 4, 4);
+	if (schemaHash != Shm::SCHEMA_HASH) {
+		Log::fatal("Journal schema hash %08lx doesn't match ours, %08lx",
+				(unsigned long)schemaHash, (unsigned long)Shm::SCHEMA_HASH);
+	}
+
+	ShmSegment::attach();
+
+	uint8_t entry[Journal::ENTRY_SIZE];
+	uint32_t lastTime = 0;
+	long entries = 0, skipped = 0;
+	while (std::fread(entry, 1, sizeof(entry), file) == sizeof(entry)) {
+		uint32_t time = readLittleEndian(entry, 4);
+		int tag = readLittleEndian(entry + 4, 2);
+
+		// Differences survive micros() wrapping
+		if (entries > 0 && speed > 0) usleep((useconds_t)((time - lastTime) / speed));
+		lastTime = time;
+		entries++;
+
+		auto var = shm().varIfExists(tag);
+		if (!var) {
+			skipped++;
+			continue;
+		}
+		apply(var, entry + 6);
+	}
+	std::fclose(file);
+
+	Log::info("Replayed %ld entries, skipping %ld with unknown tags", entries, skipped);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifdef SHM_POSIX
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "shm.h"
+#include "shm_posix.h"
+
+// How long to wait for another process to finish creating the segment
+static constexpr int CREATE_WAIT_MILLIS = 1000;
+
+static void segmentName(char* name, size_t size) {
+	std::snprintf(name, size, "/jankdrone-shm-%08x", (unsigned)Shm::SCHEMA_HASH);
+}
+
+void ShmSegment::attach() {
+	char name[32];
+	segmentName(name, sizeof(name));
+	auto begin = shm().sharedBegin();
+	auto size = shm().sharedSize();
+
+	bool created = true;
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(name, O_RDWR, 0);
+	}
+	if (fd < 0) {
+		Log::fatal("Failed to open shared memory %s: %s", name, strerror(errno));
+	}
+
+	if (created) {
+		// Others wait on the lock until the values are in
+		flock(fd, LOCK_EX);
+		if (ftruncate(fd, size) < 0 || pwrite(fd, begin, size, 0) != (ssize_t)size) {
+			Log::fatal("Failed to create shared memory %s: %s", name, strerror(errno));
+		}
+	} else {
+		// The creator may not have taken the lock yet, leaving it empty
+		struct stat st;
+		for (int waited = 0; ; waited++) {
+			flock(fd, LOCK_SH);
+			if (fstat(fd, &st) < 0) {
+				Log::fatal("Failed to stat shared memory %s: %s", name, strerror(errno));
+			}
+			if (st.st_size != 0) break;
+			flock(fd, LOCK_UN);
+			if (waited == CREATE_WAIT_MILLIS) {
+				Log::fatal("Shared memory %s was never filled in; unlink it", name);
+			}
+			usleep(1000);
+		}
+		if ((size_t)st.st_size != size) {
+			Log::fatal("Shared memory %s is %ld bytes, not %ld; built for another host?",
+					name, (long)st.st_size, (long)size);
+		}
+	}
+
+	// Replaces the pages of the groups in place, so every pointer to a
+	// variable stays valid
+	if (mmap(begin, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+				fd, 0) == MAP_FAILED) {
+		Log::fatal("Failed to map shared memory %s: %s", name, strerror(errno));
+	}
+	flock(fd, LOCK_UN);
+	close(fd);
+
+	Log::info("%s shared memory %s", created ? "Created" : "Attached to", name);
+}
+
+void ShmSegment::unlink() {
+	char name[32];
+	segmentName(name, sizeof(name));
+	if (shm_unlink(name) < 0 && errno != ENOENT) {
+		Log::error("Failed to unlink shared memory %s: %s", name, strerror(errno));
+	}
+}
+
+#endif
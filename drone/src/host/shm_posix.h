@@ -0,0 +1,26 @@
+#pragma once
+
+#ifdef SHM_POSIX
+
+/* Backs the groups of shm() with a POSIX shared memory segment, so processes
+ * on this host built from the same schema read and write the same live
+ * values: a simulator, a logger, the serial bridge or a plot. Access is the
+ * same as on the drone, plain loads and stores with no locks, and snapshot
+ * groups stay consistent across processes with one writing process each.
+ * Change versions and subscriptions stay per process, so only see writes made
+ * by that process.
+ *
+ * The segment is named after the schema hash, so processes built from
+ * different schemas never share one.
+ */
+namespace ShmSegment {
+	// Maps the segment over the groups, creating it from this process's
+	// values if it's the first. Call before using shm().
+	void attach();
+
+	// Removes the segment, so the next attach() starts from the defaults.
+	// Attached processes keep what they have.
+	void unlink();
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifdef SHM_TOOL
+
+/* Reads and writes the shm of other processes on this host through the
+ * shared segment; see shm_posix.h.
+ *
+ *     pio run -e shmtool && .pio/build/shmtool/program [-u] [name=value...]
+ *
+ * With no arguments, prints every variable and then each change as it
+ * happens. name=value arguments set variables instead, and -u removes the
+ * segment.
+ */
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <Arduino.h>
+#include "log.h"
+#include "shm.h"
+#include "shm_posix.h"
+
+HostSerial Serial;
+
+// How often to look for changes
+static constexpr useconds_t POLL_MICROS = 50000;
+
+static std::string format(const Shm::Var* var) {
+	switch (var->type()) {
+		case Shm::Var::Type::INT:
+			return std::to_string(var->get<int>());
+		case Shm::Var::Type::FLOAT:
+			return std::to_string(var->get<float>());
+		case Shm::Var::Type::BOOL:
+			return var->get<bool>() ? "true" : "false";
+		case Shm::Var::Type::STRING:
+			return var->get<std::string>();
+	}
+	return "";
+}
+
+static void set(const std::string& arg) {
+	auto eqPos = arg.find('=');
+	if (eqPos == std::string::npos) {
+		Log::fatal("Expected name=value, got %s", arg.c_str());
+	}
+	auto var = shm().var(arg.substr(0, eqPos));
+	auto value = arg.substr(eqPos + 1);
+
+	switch (var->type()) {
+		case Shm::Var::Type::INT:
+			var->set(std::stoi(value));
+			break;
+		case Shm::Var::Type::FLOAT:
+			var->set(std::stof(value));
+			break;
+		case Shm::Var::Type::BOOL:
+			var->set(value == "true" || value == "1");
+			break;
+		case Shm::Var::Type::STRING:
+			var->set(value);
+			break;
+	}
+}
+
+static void watch() {
+	std::vector<const Shm::Var*> vars;
+	for (auto group : shm().groups()) {
+		for (auto var : group->vars()) vars.push_back(var);
+	}
+
+	std::vector<std::string> last(vars.size());
+	for (size_t i = 0; i < vars.size(); i++) {
+		last[i] = format(vars[i]);
+		std::printf("%s = %s\n", vars[i]->path().c_str(), last[i].c_str());
+	}
+	std::fflush(stdout);
+
+	// Writes from other processes don't count as changes here, so compare
+	for (;;) {
+		usleep(POLL_MICROS);
+		for (size_t i = 0; i < vars.size(); i++) {
+			auto value = format(vars[i]);
+			if (value == last[i]) continue;
+			last[i] = value;
+			std::printf("%s = %s\n", vars[i]->path().c_str(), value.c_str());
+		}
+		std::fflush(stdout);
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc == 2 && std::string(argv[1]) == "-u") {
+		ShmSegment::unlink();
+		return 0;
+	}
+
+	ShmSegment::attach();
+	if (argc == 1) {
+		watch();
+	} else {
+		for (int i = 1; i < argc; i++) set(argv[i]);
+	}
+	return 0;
+}
+
+#endif
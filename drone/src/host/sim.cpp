@@ -0,0 +1,330 @@
+#ifdef SCHEDULER_SIM
+
+/* Runs the thread set from main.cpp through the real scheduler on a virtual
+ * clock, with each task's body replaced by a random execution time, and prints
+ * a schedulability report. Use it to check a new mix of rates before
+ * flashing:
+ *
+ *     pio run -e sim && .pio/build/sim/program controller=2000 telemetry=50:200,300,600
+ *
+ * Each argument is name=hz[:min,mean,max], changing the rate and optionally
+ * the execution time in micros of a task, or adding a new one. A rate of 0
+ * disables a task. -s seconds sets how long to simulate, and -p or -P runs
+ * with the pipeline enabled or disabled instead of as in shm.py. The default
+ * execution times are rough; for real figures use the threadTimeMin, Mean and
+ * Max shm groups of a drone running the same code.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <Arduino.h>
+#include "log.h"
+#include "shm.h"
+#include "thread.h"
+#include "tasks.h"
+
+HostSerial Serial;
+
+namespace {
+
+constexpr size_t MAX_TASKS = 16;
+
+// Execution times are drawn between min and max with the given mean, skewed
+// toward whichever end the mean is nearer, like runs which are usually quick
+// but sometimes take much longer
+struct ExecTime {
+	float min, mean, max;
+};
+
+class SimTask {
+	public:
+		std::string name;
+		Thread::Criticality criticality;
+		float hz;
+		unsigned long deadline; // Defaults to the interval
+		int priority;
+		bool event; // Released by an interrupt at the rate, like the IMU's
+		ExecTime exec;
+
+		const Thread* thread;
+		std::vector<unsigned long> responses;
+		unsigned long busy, misses;
+		unsigned long nextEvent;
+
+		bool enabled() const { return hz > 0; }
+		unsigned long interval() const { return enabled() ? Thread::SECOND / hz : 0; }
+
+		unsigned long relativeDeadline() const {
+			return deadline ? deadline : interval();
+		}
+
+		bool ready() const {
+			return enabled() && (long)(VirtualClock::now() - nextEvent) >= 0;
+		}
+
+		void operator()();
+};
+
+// Rough execution times of the tasks in tasks.h, in the same order
+const ExecTime EXEC_TIMES[Tasks::COUNT] = {
+	{150, 250, 400},  // pipeline
+	{1, 1, 2},        // thrust
+	{150, 250, 400},  // imu
+	{300, 400, 800},  // altimeter
+	{20, 100, 2000},  // remote
+	{1, 1, 2},        // controller
+	{5, 10, 20},      // deadman
+	{10, 15, 20},     // power
+	{500, 800, 1200}, // led
+	{5, 10, 50},      // persist
+	{5, 10, 20},      // history
+};
+
+// The threads in main.cpp, with or without the pipeline. Those which don't
+// run in that mode are disabled.
+std::vector<SimTask> defaultTasks(bool pipeline) {
+	std::vector<SimTask> defaults;
+	for (size_t i = 0; i < Tasks::COUNT; i++) {
+		auto& spec = Tasks::SPECS[i];
+		bool runs = spec.mode == Tasks::Mode::ALWAYS
+			|| (spec.mode == Tasks::Mode::PIPELINE) == pipeline;
+		float hz = runs ? (float)Thread::SECOND / spec.interval : 0;
+		defaults.push_back({spec.name, spec.criticality, hz, spec.deadline,
+				spec.priority, spec.event, EXEC_TIMES[i]});
+	}
+	return defaults;
+}
+
+SimTask tasks[MAX_TASKS];
+size_t taskCount;
+unsigned long now;
+std::mt19937 generator{1};
+
+float sample(const ExecTime& exec) {
+	if (exec.mean <= exec.min || exec.max <= exec.min) return exec.min;
+	if (exec.mean >= exec.max) return exec.max;
+
+	// min + range * u^k has mean min + range / (k + 1), which reaches any
+	// mean in between, unlike a triangular distribution. Mirror it for means
+	// above the middle.
+	float u = std::uniform_real_distribution<float>{0, 1}(generator);
+	float range = exec.max - exec.min;
+	if (exec.mean - exec.min <= exec.max - exec.mean) {
+		float k = range / (exec.mean - exec.min) - 1;
+		return exec.min + range * std::pow(u, k);
+	}
+	float k = range / (exec.max - exec.mean) - 1;
+	return exec.max - range * std::pow(u, k);
+}
+
+void SimTask::operator()() {
+	auto release = thread->releaseTime();
+	auto time = (unsigned long)sample(exec);
+	VirtualClock::advance(time);
+	busy += time;
+
+	auto response = VirtualClock::now() - release;
+	responses.push_back(response);
+	if (response > relativeDeadline()) misses++;
+
+	// Samples which arrived while we were still busy are lost. Periodic
+	// tasks running less often because they were shed show up in the runs.
+	if (event) {
+		nextEvent += interval();
+		while (ready()) {
+			nextEvent += interval();
+			misses++;
+		}
+	}
+}
+
+template <size_t I>
+bool taskEvent() {
+	return tasks[I].event && tasks[I].ready();
+}
+
+// Disabled tasks are event tasks whose event never fires
+template <size_t I>
+Task<SimTask&> makeTask() {
+	auto& task = tasks[I];
+	if (task.event || !task.enabled()) {
+		return {task.name.c_str(), task, task.criticality, 0,
+			task.relativeDeadline(), task.priority, &taskEvent<I>};
+	}
+	return {task.name.c_str(), task, task.criticality, task.interval(),
+		task.deadline, task.priority};
+}
+
+template <size_t>
+using SlotTask = Task<SimTask&>;
+
+template <typename Indices>
+struct Sim;
+
+template <size_t... I>
+struct Sim<std::index_sequence<I...>> {
+	Scheduler<SlotTask<I>...> scheduler;
+
+	Sim(): scheduler{makeTask<I>()...} {
+		for (size_t i = 0; i < sizeof...(I); i++) tasks[i].thread = &scheduler.thread(i);
+	}
+};
+
+bool parseTask(const std::string& arg) {
+	auto equals = arg.find('=');
+	if (equals == std::string::npos) return false;
+	auto name = arg.substr(0, equals);
+
+	SimTask* task = nullptr;
+	for (size_t i = 0; i < taskCount; i++) {
+		if (tasks[i].name == name) task = &tasks[i];
+	}
+	if (!task) {
+		if (taskCount == MAX_TASKS) {
+			Log::fatal("Too many tasks, at most %d", (int)MAX_TASKS);
+		}
+		task = &tasks[taskCount++];
+		*task = {name, Thread::Criticality::NORMAL, 0, 0, 0, false, {0, 0, 0}};
+	}
+
+	ExecTime exec = task->exec;
+	int fields = std::sscanf(arg.c_str() + equals + 1, "%f:%f,%f,%f",
+			&task->hz, &exec.min, &exec.mean, &exec.max);
+	if (fields == 4) {
+		task->exec = exec;
+	} else if (fields != 1) {
+		return false;
+	}
+	return true;
+}
+
+unsigned long percentile(std::vector<unsigned long> values, float p) {
+	if (values.empty()) return 0;
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (size_t)(values.size() * p))];
+}
+
+const char* criticalityString(Thread::Criticality criticality) {
+	switch (criticality) {
+		case Thread::Criticality::BEST_EFFORT: return "best effort";
+		case Thread::Criticality::NORMAL: return "normal";
+		default: return "flight";
+	}
+}
+
+void report(unsigned long duration) {
+	std::printf("Simulated %.1f s\n\n", duration / (float)Thread::SECOND);
+	std::printf("%-12s %-11s %7s %9s %7s %7s %9s %9s %9s %7s\n", "task",
+			"criticality", "rate Hz", "deadline", "runs", "util %",
+			"resp mean", "resp p99", "resp max", "misses");
+
+	unsigned long busy = 0;
+	float worstUtilization = 0;
+	for (size_t i = 0; i < taskCount; i++) {
+		auto& task = tasks[i];
+		if (!task.enabled()) continue;
+
+		unsigned long total = 0, max = 0;
+		for (auto response : task.responses) {
+			total += response;
+			max = std::max(max, response);
+		}
+		auto runs = task.responses.size();
+		std::printf("%-12s %-11s %7.1f %9lu %7lu %7.2f %9lu %9lu %9lu %7lu\n",
+				task.name.c_str(), criticalityString(task.criticality), task.hz,
+				task.relativeDeadline(), (unsigned long)runs,
+				100.0f * task.busy / duration, runs ? total / runs : 0,
+				percentile(task.responses, 0.99), max, task.misses);
+
+		busy += task.busy;
+		worstUtilization += task.exec.max / task.interval();
+	}
+
+	std::printf("\nUtilization %.1f %%, idle %.1f %%, shed level %d at the end after %d sheds\n",
+			100.0f * busy / duration, 100.0f * (duration - busy) / duration,
+			shm().scheduler.shedLevel, shm().scheduler.shedEvents);
+
+	// Non-preemptive EDF: the worst case must fit, and every deadline must
+	// cover the task's own longest run plus the longest run it can get
+	// stuck behind
+	std::printf("\nWorst-case utilization %.1f %%: %s\n", 100 * worstUtilization,
+			worstUtilization <= 1 ? "ok" : "overloaded");
+	for (size_t i = 0; i < taskCount; i++) {
+		auto& task = tasks[i];
+		if (!task.enabled()) continue;
+
+		const SimTask* blocker = nullptr;
+		for (size_t j = 0; j < taskCount; j++) {
+			if (j == i || !tasks[j].enabled()) continue;
+			if (!blocker || tasks[j].exec.max > blocker->exec.max) blocker = &tasks[j];
+		}
+		float worst = task.exec.max + (blocker ? blocker->exec.max : 0);
+		if (worst > task.relativeDeadline()) {
+			std::printf("%s may miss: deadline %lu us, but runs %.0f us and can be "
+					"blocked %.0f us by %s\n", task.name.c_str(),
+					task.relativeDeadline(), task.exec.max, blocker->exec.max,
+					blocker->name.c_str());
+		}
+	}
+}
+
+}
+
+namespace VirtualClock {
+	unsigned long now() {
+		return ::now;
+	}
+
+	void advance(unsigned long micros) {
+		::now += micros;
+	}
+
+	void sleep(unsigned long until) {
+		for (size_t i = 0; i < taskCount; i++) {
+			auto& task = tasks[i];
+			if (task.event && task.enabled() && (long)(task.nextEvent - until) < 0) {
+				until = task.nextEvent;
+			}
+		}
+		if ((long)(until - ::now) > 0) ::now = until;
+	}
+}
+
+int main(int argc, char** argv) {
+	float seconds = 10;
+	bool pipeline = shm().pipeline.enabled;
+	std::vector<std::string> taskArgs;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-s" && i + 1 < argc) {
+			seconds = std::atof(argv[++i]);
+		} else if (arg == "-p" || arg == "-P") {
+			pipeline = arg == "-p";
+		} else {
+			taskArgs.push_back(arg);
+		}
+	}
+
+	auto defaults = defaultTasks(pipeline);
+	for (auto& task : defaults) tasks[taskCount++] = task;
+	for (auto& arg : taskArgs) {
+		if (!parseTask(arg)) {
+			Log::fatal("Expected name=hz[:min,mean,max], -s seconds, -p or -P, got %s",
+					arg.c_str());
+		}
+	}
+
+	Sim<std::make_index_sequence<MAX_TASKS>> sim;
+	unsigned long start = now, duration = seconds * Thread::SECOND;
+	for (size_t i = 0; i < taskCount; i++) tasks[i].nextEvent = start;
+	while (now - start < duration) sim.scheduler();
+
+	report(now - start);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+// Time for host builds, which only moves when told to
+namespace VirtualClock {
+	unsigned long now();
+
+	// Spend time running
+	void advance(unsigned long micros);
+
+	// Spend time idle until the given time, or until a simulated interrupt
+	// if one comes first
+	void sleep(unsigned long until);
+}
@@ -1,4 +1,5 @@
 #include "log.h"
+#include "shm.h"
 #include "mpu9250.h"
 #include "imu.h"
 
@@ -11,3 +12,7 @@ Imu::Imu() {
 void Imu::operator()() {
 	MPU9250::loop();
 }
+
+bool Imu::ready() {
+	return !ShmVars::pipeline::enabled.get() && MPU9250::dataReady();
+}
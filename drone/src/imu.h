@@ -4,4 +4,7 @@ class Imu {
 	public:
 		Imu();
 		void operator()();
+
+		// Thread event: is a sample waiting while the pipeline is disabled?
+		static bool ready();
 };
@@ -0,0 +1,76 @@
+#ifdef SHM_JOURNAL
+
+#include <Arduino.h>
+#include <cstring>
+#include "shm.h"
+#include "journal.h"
+
+namespace {
+
+#ifdef JOURNAL_ENTRIES
+constexpr int ENTRIES = JOURNAL_ENTRIES;
+#else
+constexpr int ENTRIES = 2048;
+#endif
+
+struct __attribute__((packed)) Entry {
+	uint32_t time;
+	uint16_t tag;
+	uint8_t value[4];
+};
+static_assert(sizeof(Entry) == Journal::ENTRY_SIZE, "Journal entries must be packed");
+
+// A ring, overwriting the oldest entry when full
+Entry entries[ENTRIES];
+int oldest = 0, count = 0;
+
+}
+
+void Journal::record(int tag) {
+	if (!shm().journal.recording) return;
+
+	auto& entry = entries[(oldest + count) % ENTRIES];
+	if (count < ENTRIES) {
+		count++;
+	} else {
+		oldest = (oldest + 1) % ENTRIES;
+	}
+
+	auto var = shm().var(tag);
+	entry.time = micros();
+	entry.tag = tag;
+	memset(entry.value, 0, sizeof(entry.value));
+	switch (var->type()) {
+		case Shm::Var::Type::INT:
+			memcpy(entry.value, var->ptr<int>(), sizeof(entry.value));
+			break;
+		case Shm::Var::Type::FLOAT:
+			memcpy(entry.value, var->ptr<float>(), sizeof(entry.value));
+			break;
+		case Shm::Var::Type::BOOL:
+			entry.value[0] = var->get<bool>();
+			break;
+		case Shm::Var::Type::STRING:
+			break;
+	}
+
+	// Keep the kill as the last entry
+	if (tag == ShmVars::switches::softKill.tag() && shm().switches.softKill) {
+		ShmVars::journal::recording.set(false);
+	}
+}
+
+size_t Journal::drain(uint8_t* buf, size_t size) {
+	ShmVars::journal::recording.set(false);
+
+	size_t written = 0;
+	while (count > 0 && written + ENTRY_SIZE <= size) {
+		memcpy(buf + written, &entries[oldest], ENTRY_SIZE);
+		written += ENTRY_SIZE;
+		oldest = (oldest + 1) % ENTRIES;
+		count--;
+	}
+	return written;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Records every change to shm, with its time, tag and new value, in a ring of the
+ * most recent ones, for builds with -DSHM_JOURNAL. Recording stops when soft
+ * killed or when a remote starts draining it, so what led up to a crash
+ * stays until journal.recording is set again. Replay drained journals on the
+ * host with src/host/journal_replay.cpp.
+ *
+ * Only changes published through Shm::touch are recorded, which every
+ * Var::set, handle set and snapshot write does. Flight code writes through
+ * those; the thread*, scheduler and pipeline statistics are assigned directly
+ * and left out. In flight the controller's outputs and thrusters change about
+ * 8000 times a second and placement 1600, so the default 2048 entries hold
+ * about the last 0.2 s. Each entry takes ENTRY_SIZE bytes of RAM; set
+ * JOURNAL_ENTRIES for a longer window if there's room.
+ *
+ * Entries are little-endian and packed: a 32-bit time in micros, a 16-bit tag
+ * and 4 bytes of value, which is an int or float, or a bool in the first
+ * byte.
+ */
+class Journal {
+	public:
+		static constexpr size_t ENTRY_SIZE = 10;
+
+		// Called for every changed tag, so it must stay short. Not from
+		// interrupts.
+		static void record(int tag);
+
+		// Moves as many of the oldest entries as fit into buf, returning the
+		// bytes written, and stops recording
+		static size_t drain(uint8_t* buf, size_t size);
+};
@@ -1,6 +1,7 @@
 #include "teensy.h"
 #include <Arduino.h>
 #include "thread.h"
+#include "tasks.h"
 #include "log.h"
 #include "shm.h"
 
@@ -12,6 +13,11 @@
 #include "thrust.h"
 #include "power.h"
 #include "deadman.h"
+#include "pipeline.h"
+#include "persist.h"
+#include "history.h"
+#include "benchmark.h"
+#include "ram_report.h"
 
 struct Main {
 	Thrust thrust;
@@ -20,21 +26,60 @@ struct Main {
 	Remote remote;
 	Controller controller;
 	Deadman deadman;
+	Persist persist;
+	History history;
 
-	FuncSet threads;
+	Pipeline pipeline;
 
-	Main(): threads{
-		Thread([&] { thrust(); }, Thread::SECOND / 1000, &shm().threadTime.thrust),
-		Thread([&] { imu(); }, 0, &shm().threadTime.imu),
-		Thread([&] { altimeter(); }, Thread::SECOND / 15, &shm().threadTime.altimeter),
-		Thread([&] { remote(); }, 0, &shm().threadTime.remote),
-		Thread([&] { controller(); }, Thread::SECOND / 1000, &shm().threadTime.controller),
-		Thread([&] { deadman(); }, Thread::SECOND / 30),
-		Thread(&Power::readVoltage, Thread::SECOND / 10),
-		Thread(&Led::showShm, Thread::SECOND / 30, &shm().threadTime.led),
-	} {}
+	Scheduler<
+		Task<Pipeline&>,
+		Task<Thrust&>,
+		Task<Imu&>,
+		Task<Altimeter&>,
+		Task<Remote&>,
+		Task<Controller&>,
+		Task<Deadman&>,
+		Task<Func<&Power::readVoltage>>,
+		Task<Func<&Led::showShm>>,
+		Task<Persist&>,
+		Task<History&>
+	> threads;
 
-	void operator()() { while (true) threads(); }
+	Main():
+		pipeline{controller, thrust},
+		threads{
+			Tasks::make<Pipeline&>(Tasks::PIPELINE, pipeline, &Pipeline::ready),
+			Tasks::make<Thrust&>(Tasks::THRUST, thrust, nullptr, &Pipeline::disabled),
+			Tasks::make<Imu&>(Tasks::IMU, imu, &Imu::ready),
+			Tasks::make<Altimeter&>(Tasks::ALTIMETER, altimeter),
+			Tasks::make<Remote&>(Tasks::REMOTE, remote),
+			Tasks::make<Controller&>(Tasks::CONTROLLER, controller, nullptr, &Pipeline::disabled),
+			Tasks::make<Deadman&>(Tasks::DEADMAN, deadman),
+			Tasks::make(Tasks::POWER, Func<&Power::readVoltage>{}),
+			Tasks::make(Tasks::LED, Func<&Led::showShm>{}),
+			Tasks::make<Persist&>(Tasks::PERSIST, persist),
+			Tasks::make<History&>(Tasks::HISTORY, history),
+		} {
+		static_assert(decltype(threads)::SIZE == Tasks::COUNT,
+				"Every task in tasks.h needs a thread");
+	}
+
+	void operator()() {
+#ifdef COUNT_ALLOCATIONS
+		// Counted after logging, which may allocate itself
+		unsigned long counted = heapAllocations(), lastReport = millis();
+		while (true) {
+			threads();
+			if (millis() - lastReport < 1000) continue;
+			lastReport = millis();
+			Log::info("Heap allocations in the flight loop over the last second: %lu",
+					heapAllocations() - counted);
+			counted = heapAllocations();
+		}
+#else
+		while (true) threads();
+#endif
+	}
 };
 
 void setup() {
@@ -43,8 +88,17 @@ void setup() {
 	//while (!Serial);
 
 	Led::off();
+	Persist::load();
+
+#ifdef BENCHMARK_SCHEDULER
+	benchmarkScheduler();
+	benchmarkShmSnapshot();
+#endif
 	
 	static Main main;
+#ifdef SHM_RAM_REPORT
+	reportRam();
+#endif
 	main();
 }
 
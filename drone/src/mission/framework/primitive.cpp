@@ -19,19 +19,19 @@ bool Function::onFirstRun() {
 }
 
 Logger::Logger(Log::Level level, std::string msg):
-	Function{[=] { Log::log(level, msg); }} {}
+	Function{[=] { Log::log(level, msg.c_str()); }} {}
 
 Debug::Debug(std::string msg):
-	Function{[=] { Log::debug(msg); }} {}
+	Function{[=] { Log::debug(msg.c_str()); }} {}
 
 Info::Info(std::string msg):
-	Function{[=] { Log::info(msg); }} {}
+	Function{[=] { Log::info(msg.c_str()); }} {}
 
 Warn::Warn(std::string msg):
-	Function{[=] { Log::warn(msg); }} {}
+	Function{[=] { Log::warn(msg.c_str()); }} {}
 
 Error::Error(std::string msg):
-	Function{[=] { Log::error(msg); }} {}
+	Function{[=] { Log::error(msg.c_str()); }} {}
 
 Fatal::Fatal(std::string msg):
-	Function{[=] { Log::fatal(msg); }} {}
+	Function{[=] { Log::fatal(msg.c_str()); }} {}
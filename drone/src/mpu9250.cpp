@@ -34,13 +34,13 @@
 //#include "Wire.h"   
 #include <i2c_t3.h>
 #include <SPI.h>
-#include <EEPROM.h>
 #include "shm.h"
 #include "thread.h"
 #include "log.h"
 #include "led.h"
 #include "maths.h"
 #include "config.h"
+#include "persist.h"
 #include "mpu9250.h"
 
 namespace MPU9250 {
@@ -255,6 +255,7 @@ float aRes, gRes, mRes;      // scale resolutions per LSB for the sensors
 // Pin definitions
 int intPin = IMU_INT_PIN;
 volatile bool newData = false;
+volatile unsigned long newDataTime = 0; // micros() when newData was raised
 bool newMagData = false;
 
 int myLed = 13;
@@ -365,23 +366,33 @@ float eInt[3] = {0.0f, 0.0f, 0.0f};       // vector to hold integral error for M
         }
         }
 
-        uint32_t MS5637Read(uint8_t CMD, uint8_t OSR)  // temperature data read
+        // Conversion time of an oversampling rate in microseconds
+        unsigned long MS5637ConversionMicros(uint8_t OSR)
         {
-        uint8_t data[3] = {0,0,0};
+        switch (OSR)
+        {
+          case ADC_256: return 1000;
+          case ADC_512: return 3000;
+          case ADC_1024: return 4000;
+          case ADC_2048: return 6000;
+          case ADC_4096: return 10000;
+          default: return 20000;
+        }
+        }
+
+        // Resumable so the conversion of up to 20 ms doesn't block other
+        // threads; call until finished, then the reading is in result
+        Coroutine::Status MS5637Read(Coroutine& co, uint8_t CMD, uint8_t OSR, uint32_t* result)  // temperature data read
+        {
+        CO_BEGIN(co);
         Wire.beginTransmission(MS5637_ADDRESS);  // Initialize the Tx buffer
         Wire.write(CMD | OSR);                  // Put pressure conversion command in Tx buffer
         Wire.endTransmission(I2C_NOSTOP);        // Send the Tx buffer, but send a restart to keep connection alive
-        
-        switch (OSR)
+
+        CO_SLEEP(co, MS5637ConversionMicros(OSR)); // wait for conversion to complete
+
         {
-          case ADC_256: delay(1); break;  // delay for conversion to complete
-          case ADC_512: delay(3); break;
-          case ADC_1024: delay(4); break;
-          case ADC_2048: delay(6); break;
-          case ADC_4096: delay(10); break;
-          case ADC_8192: delay(20); break;
-        }
-       
+        uint8_t data[3] = {0,0,0};
         Wire.beginTransmission(MS5637_ADDRESS);  // Initialize the Tx buffer
         Wire.write(0x00);                        // Put ADC read command in Tx buffer
         Wire.endTransmission(I2C_NOSTOP);        // Send the Tx buffer, but send a restart to keep connection alive
@@ -389,7 +400,9 @@ float eInt[3] = {0.0f, 0.0f, 0.0f};       // vector to hold integral error for M
         Wire.requestFrom(MS5637_ADDRESS, 3);     // Read three bytes from slave PROM address 
 	while (Wire.available()) {
         data[i++] = Wire.read(); }               // Put read results in the Rx buffer
-        return (uint32_t) (((uint32_t) data[0] << 16) | (uint32_t) data[1] << 8 | data[2]); // construct PROM data for return to main program
+        *result = (uint32_t) (((uint32_t) data[0] << 16) | (uint32_t) data[1] << 8 | data[2]); // construct PROM data for return to main program
+        }
+        CO_END(co);
         }
 
 
@@ -467,6 +480,7 @@ void I2Cscan()
 
 void myinthandler()
 {
+  newDataTime = micros();
   newData = true;
 }
 
@@ -818,7 +832,7 @@ void magcalMPU9250(float * dest1, float * dest2)
   int32_t mag_bias[3] = {0, 0, 0}, mag_scale[3] = {0, 0, 0};
   int16_t mag_max[3] = {-32767, -32767, -32767}, mag_min[3] = {32767, 32767, 32767}, mag_temp[3] = {0, 0, 0};
 
-  if (!EEPROM.read(IMU_CALIBRATED_ADDRESS)) {
+  if (!shm().calibration.imu) {
 	  Led::calibration();
 	  Serial.println("Mag Calibration: Wave device in a figure eight until done!");
 	  delay(4000);
@@ -839,16 +853,21 @@ void magcalMPU9250(float * dest1, float * dest2)
 		//    Serial.println("mag x min/max:"); Serial.println(mag_max[0]); Serial.println(mag_min[0]);
 		//    Serial.println("mag y min/max:"); Serial.println(mag_max[1]); Serial.println(mag_min[1]);
 		//    Serial.println("mag z min/max:"); Serial.println(mag_max[2]); Serial.println(mag_min[2]);
-	  EEPROM.put(IMU_CALIBRATION_ADDRESS, mag_max);
-	  EEPROM.put(IMU_CALIBRATION_ADDRESS + sizeof(mag_max), mag_min);
-	  EEPROM.update(IMU_CALIBRATED_ADDRESS, true);
+	  for (int i = 0; i < 3; i++) {
+		  ShmVars::calibration::magMax[i].set(mag_max[i]);
+		  ShmVars::calibration::magMin[i].set(mag_min[i]);
+	  }
+	  ShmVars::calibration::imu.set(true);
+	  Persist::save();
   
 	  Serial.println("Mag Calibration done!");
 	  Led::off();
   }
 
-	EEPROM.get(IMU_CALIBRATION_ADDRESS, mag_max);
- 	EEPROM.get(IMU_CALIBRATION_ADDRESS + sizeof(mag_max), mag_min);
+	for (int i = 0; i < 3; i++) {
+		mag_max[i] = shm().calibration.magMax[i];
+		mag_min[i] = shm().calibration.magMin[i];
+	}
 
 		// Get hard iron correction
     mag_bias[0]  = (mag_max[0] + mag_min[0])/2;  // get average x mag bias in counts
@@ -1209,11 +1228,18 @@ void updatePlacement() {
 		roll = -roll;
 	}
 
-	shm().placement.yaw = splitFmod(yaw, 360);
-	shm().placement.pitch = splitFmod(pitch, 360);
-	shm().placement.roll = splitFmod(roll, 360);
+	// Publish angles with the rates of the same sample
+	shm().placement.write([](Shm::Group_placement::Values& placement) {
+		placement.yaw = splitFmod(yaw, 360);
+		placement.pitch = splitFmod(pitch, 360);
+		placement.roll = splitFmod(roll, 360);
+		placement.yawVel = NEGATE_YAW ? -gz : gz;
+		placement.pitchVel = NEGATE_PITCH ? -gy : gy;
+		placement.rollVel = NEGATE_ROLL ? -gx : gx;
+	});
 }
-Thread updatePlacementThread(&updatePlacement, Thread::SECOND / 1000);
+Task<Func<&updatePlacement>> updatePlacementThread{"updatePlacement", {},
+	Thread::Criticality::FLIGHT, Thread::SECOND / 1000};
 
 void setup()
 {
@@ -1321,14 +1347,18 @@ void setup()
   }
 }
 
-void loop()
-{  
+void checkCalibrate()
+{
   if (shm().switches.calibrateImu) {
-	  EEPROM.put(IMU_CALIBRATED_ADDRESS, false);
+	  ShmVars::calibration::imu.set(false);
+	  Persist::save();
 	  Log::fatal("Shutting down to calibrate IMU");
   }
-  // If intPin goes high, all data registers have new data
-   if(newData == true) {  // On interrupt, read data
+}
+
+// Read the sample signalled by newData
+void readSample()
+{
      newData = false;  // reset newData flag
      readMPU9250Data(MPU9250Data); // INT cleared on any read
  //   readAccelData(accelCount);  // Read the x/y/z adc values
@@ -1344,10 +1374,6 @@ void loop()
     gx = (float)MPU9250Data[4]*gRes;  // get actual gyro value, this depends on scale being set
     gy = (float)MPU9250Data[5]*gRes;  
     gz = (float)MPU9250Data[6]*gRes;   
-
-	shm().placement.yawVel = NEGATE_YAW ? -gz : gz;
-	shm().placement.pitchVel = NEGATE_PITCH ? -gy : gy;
-	shm().placement.rollVel = NEGATE_ROLL ? -gx : gx;
   
     readMagData(magCount);  // Read the x/y/z adc values
    
@@ -1362,8 +1388,11 @@ void loop()
       my *= magScale[1];
       mz *= magScale[2]; 
     } 
-  }
-  
+}
+
+// Update the orientation filter with the latest sample
+void fuse()
+{
   Now = micros();
   deltat = ((Now - lastUpdate)/1000000.0f); // set integration time by time elapsed since last filter update
   lastUpdate = Now;
@@ -1406,7 +1435,7 @@ void loop()
     tempCount = readTempData();  // Read the gyro adc values
     temperature = ((float) tempCount) / 333.87 + 21.0; // Gyro chip temperature in degrees Centigrade
    // Print temperature in degrees Centigrade      
-   shm().temperature.gyro = temperature;
+   ShmVars::temperature::gyro.set(temperature);
 
 #ifdef DEBUG
     Serial.print("Gyro temperature is ");  Serial.print(temperature, 1);  Serial.println(" degrees C"); // Print T values to tenths of s degree C
@@ -1450,8 +1479,36 @@ void loop()
     sumCount = 0;
     sum = 0;    
     }
+}
+
+void loop()
+{  
+  checkCalibrate();
+  // If intPin goes high, all data registers have new data
+  if(newData == true) {  // On interrupt, read data
+    readSample();
+  }
+  fuse();
 
 	updatePlacementThread();
 }
 
+bool dataReady()
+{
+  return newData;
+}
+
+unsigned long sampleTime()
+{
+  return newDataTime;
+}
+
+void update()
+{
+  checkCalibrate();
+  readSample();
+  fuse();
+  updatePlacement();
+}
+
 } // namespace MPU9250
@@ -2,5 +2,16 @@
 
 namespace MPU9250 {
 	void setup();
+
+	// Read a sample if one is ready, then update the orientation filter
 	void loop();
+
+	// Has the data-ready interrupt signalled a sample not yet read?
+	bool dataReady();
+
+	// Time in micros of the latest data-ready interrupt
+	unsigned long sampleTime();
+
+	// Read the ready sample, fuse it and publish the new placement at once
+	void update();
 }
@@ -0,0 +1,287 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <algorithm>
+#include <cstring>
+#include "log.h"
+#include "shm.h"
+#include "persist.h"
+
+namespace {
+
+constexpr uint16_t MAGIC = 0x4a44;
+constexpr uint8_t FORMAT = 1;
+constexpr int SLOT_SIZE = 256;
+
+struct Header {
+	uint16_t magic;
+	uint8_t format, count;
+	uint32_t sequence;
+	uint16_t crc;
+};
+
+// A value is stored as the var's int or float, or a bool in the first byte
+struct Entry {
+	uint16_t key;
+	uint8_t value[4];
+};
+
+constexpr int MAX_ENTRIES = (SLOT_SIZE - sizeof(Header)) / sizeof(Entry);
+static_assert(Shm::NUM_PERSISTENT <= MAX_ENTRIES,
+		"Too many persistent vars for an EEPROM slot");
+
+struct Record {
+	Header header;
+	Entry entries[MAX_ENTRIES];
+};
+static_assert(sizeof(Record) <= SLOT_SIZE, "EEPROM record overflows its slot");
+
+// Slot of the newest record, and its sequence number
+int newestSlot = -1;
+uint32_t newestSequence = 0;
+
+// Key of each persistent var in tag order
+uint16_t keys[Shm::NUM_PERSISTENT];
+
+Record pending;
+
+// CRC-16-CCITT
+uint16_t crc16(const void* data, size_t size, uint16_t crc = 0xffff) {
+	auto bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= bytes[i] << 8;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+uint16_t recordCrc(const Record& record) {
+	auto header = record.header;
+	header.crc = 0;
+	return crc16(record.entries, sizeof(Entry) * record.header.count,
+			crc16(&header, sizeof(header)));
+}
+
+int numSlots() {
+	return EEPROM.length() / SLOT_SIZE;
+}
+
+bool readSlot(int slot, Record& record) {
+	EEPROM.get(slot * SLOT_SIZE, record.header);
+	auto& header = record.header;
+	if (header.magic != MAGIC || header.format != FORMAT
+			|| header.count > MAX_ENTRIES) {
+		return false;
+	}
+
+	for (int i = 0; i < header.count; i++) {
+		EEPROM.get(slot * SLOT_SIZE + sizeof(Header) + i * sizeof(Entry),
+				record.entries[i]);
+	}
+	return recordCrc(record) == header.crc;
+}
+
+// Calls f(var, key) for each persistent var
+template <typename F>
+void forEachPersistent(F f) {
+	int i = 0;
+	for (int tag = 0; tag < Shm::NUM_VARS; tag++) {
+		auto var = shm().var(tag);
+		if (var->persistent()) f(var, keys[i++]);
+	}
+}
+
+void computeKeys() {
+	int i = 0;
+	for (int tag = 0; tag < Shm::NUM_VARS; tag++) {
+		auto var = shm().var(tag);
+		if (!var->persistent()) continue;
+
+		auto path = var->path();
+		auto type = (uint8_t)var->type();
+		keys[i] = crc16(&type, 1, crc16(path.c_str(), path.size()));
+		for (int j = 0; j < i; j++) {
+			if (keys[j] == keys[i]) {
+				Log::fatal("Persistent var %s has the same key as another",
+						path.c_str());
+			}
+		}
+		i++;
+	}
+}
+
+void fillRecord(Record& record, uint32_t sequence) {
+	memset(&record, 0, sizeof(record));
+	int count = 0;
+	forEachPersistent([&](const Shm::Var* var, uint16_t key) {
+		auto& entry = record.entries[count++];
+		entry.key = key;
+		switch (var->type()) {
+			case Shm::Var::Type::INT:
+				{
+					int value = var->get<int>();
+					memcpy(entry.value, &value, sizeof(value));
+				}
+				break;
+			case Shm::Var::Type::FLOAT:
+				{
+					float value = var->get<float>();
+					memcpy(entry.value, &value, sizeof(value));
+				}
+				break;
+			case Shm::Var::Type::BOOL:
+				entry.value[0] = var->get<bool>();
+				break;
+			case Shm::Var::Type::STRING:
+				Log::fatal("Can't persist string %s", var->path().c_str());
+				break;
+		}
+	});
+
+	record.header = {MAGIC, FORMAT, (uint8_t)count, sequence, 0};
+	record.header.crc = recordCrc(record);
+}
+
+void applyRecord(const Record& record) {
+	forEachPersistent([&](const Shm::Var* var, uint16_t key) {
+		for (int i = 0; i < record.header.count; i++) {
+			auto& entry = record.entries[i];
+			if (entry.key != key) continue;
+
+			switch (var->type()) {
+				case Shm::Var::Type::INT:
+					{
+						int value;
+						memcpy(&value, entry.value, sizeof(value));
+						var->set(value);
+					}
+					break;
+				case Shm::Var::Type::FLOAT:
+					{
+						float value;
+						memcpy(&value, entry.value, sizeof(value));
+						var->set(value);
+					}
+					break;
+				case Shm::Var::Type::BOOL:
+					var->set((bool)entry.value[0]);
+					break;
+				case Shm::Var::Type::STRING:
+					break;
+			}
+			return;
+		}
+	});
+}
+
+void writeBytes(int slot, const Record& record, int start, int end) {
+	auto bytes = (const uint8_t*)&record;
+	for (int i = start; i < end; i++) {
+		EEPROM.update(slot * SLOT_SIZE + i, bytes[i]);
+	}
+}
+
+// Before records, the calibrated flags of the ESCs and IMU were single bytes at
+// the start of EEPROM, followed by the magnetometer maxes and mins as int16s.
+// Takes them into the calibration group if they look written, returning
+// whether they did; erased EEPROM reads 0xff.
+bool migrateLegacy() {
+	constexpr int ESCS_CALIBRATED_ADDRESS = 0,
+			  IMU_CALIBRATED_ADDRESS = 1,
+			  IMU_CALIBRATION_ADDRESS = 2;
+
+	uint8_t escs = EEPROM.read(ESCS_CALIBRATED_ADDRESS),
+			imu = EEPROM.read(IMU_CALIBRATED_ADDRESS);
+	if (escs > 1 || imu > 1) return false;
+
+	ShmVars::calibration::escs.set((bool)escs);
+	ShmVars::calibration::imu.set((bool)imu);
+	if (imu) {
+		int16_t magMax[3], magMin[3];
+		EEPROM.get(IMU_CALIBRATION_ADDRESS, magMax);
+		EEPROM.get(IMU_CALIBRATION_ADDRESS + sizeof(magMax), magMin);
+		for (int i = 0; i < 3; i++) {
+			ShmVars::calibration::magMax[i].set(magMax[i]);
+			ShmVars::calibration::magMin[i].set(magMin[i]);
+		}
+	}
+	return true;
+}
+
+// Claims the slot after the newest for a record, so a save started while
+// another is being written can't land on the same one
+int claimSlot(Record& record) {
+	int slot = (newestSlot + 1) % numSlots();
+	fillRecord(record, ++newestSequence);
+	newestSlot = slot;
+	return slot;
+}
+
+}
+
+Persist::Persist(): m_savedVersion{shm().version()}, m_slot{0}, m_written{0} {}
+
+Coroutine::Status Persist::operator()() {
+	CO_BEGIN(m_co);
+
+	if (changed(m_savedVersion)) {
+		// Wait out bursts of tuning, and don't stall flight threads on
+		// EEPROM writes mid-flight
+		CO_SLEEP(m_co, SETTLE_MICROS);
+		CO_AWAIT(m_co, shm().switches.softKill, POLL_MICROS);
+
+		m_savedVersion = shm().version();
+		m_slot = claimSlot(pending);
+		for (m_written = 0; m_written < (int)sizeof(Record); m_written += CHUNK) {
+			writeBytes(m_slot, pending, m_written,
+					std::min(m_written + CHUNK, (int)sizeof(Record)));
+			CO_YIELD(m_co);
+		}
+	}
+
+	CO_END(m_co);
+}
+
+void Persist::load() {
+	computeKeys();
+
+	Record record;
+	newestSlot = -1;
+	for (int slot = 0; slot < numSlots(); slot++) {
+		if (!readSlot(slot, record)) continue;
+		if (newestSlot < 0 || (int32_t)(record.header.sequence - newestSequence) > 0) {
+			newestSlot = slot;
+			newestSequence = record.header.sequence;
+			pending = record;
+		}
+	}
+
+	if (newestSlot < 0) {
+		if (migrateLegacy()) {
+			// Recorded over the old bytes, so this only happens once
+			save();
+			Log::info("Moved calibration from the old EEPROM layout");
+		} else {
+			Log::info("No saved settings in EEPROM, using defaults");
+		}
+		return;
+	}
+
+	applyRecord(pending);
+	Log::info("Loaded %d saved settings from EEPROM", pending.header.count);
+}
+
+void Persist::save() {
+	Record record;
+	int slot = claimSlot(record);
+	writeBytes(slot, record, 0, sizeof(Record));
+}
+
+bool Persist::changed(unsigned version) {
+	bool any = false;
+	shm().changedSince(version, [&](const Shm::Var* var) {
+		if (var->persistent()) any = true;
+	});
+	return any;
+}
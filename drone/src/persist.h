@@ -0,0 +1,39 @@
+#pragma once
+
+#include "coroutine.h"
+
+/* Keeps the shm variables marked persistent in shm.py in EEPROM. The EEPROM
+ * is split into fixed slots, and each save writes a whole record to the slot
+ * after the newest one, so writes are spread over every slot and a save cut
+ * off by a reset leaves the previous record intact. Records carry a format
+ * version, a sequence number and a CRC, and match variables by a hash of
+ * their path and type rather than by tag, so settings survive changes to the
+ * schema; new variables start at their defaults.
+ */
+class Persist {
+	public:
+		Persist();
+
+		// Saves once changes to persistent variables have settled and the
+		// drone is soft killed, a few bytes per run
+		Coroutine::Status operator()();
+
+		// Loads the newest valid record over the defaults. Call before
+		// anything reads persistent variables.
+		static void load();
+
+		// Saves now, waiting for the writes, like before shutting down
+		static void save();
+
+	private:
+		static constexpr unsigned long SETTLE_MICROS = 2000000,
+				  POLL_MICROS = 100000;
+		// Bytes written per run, as each can take a millisecond
+		static constexpr int CHUNK = 4;
+
+		Coroutine m_co;
+		unsigned m_savedVersion;
+		int m_slot, m_written;
+
+		static bool changed(unsigned version);
+};
@@ -0,0 +1,38 @@
+#include <Arduino.h>
+#include "shm.h"
+#include "thread.h"
+#include "mpu9250.h"
+#include "pipeline.h"
+
+Pipeline::Pipeline(Controller& controller, Thrust& thrust):
+	m_controller(controller),
+	m_thrust(thrust),
+	m_windowStart{0},
+	m_maxLatency{0} {}
+
+void Pipeline::operator()() {
+	auto sampleTime = MPU9250::sampleTime();
+
+	MPU9250::update();
+	m_controller();
+	m_thrust();
+
+	// Sensor-to-motor latency: data-ready interrupt to thrust written
+	auto t = micros();
+	int latency = t - sampleTime;
+	shm().pipeline.latency = latency;
+	if (latency > m_maxLatency) m_maxLatency = latency;
+	if (t - m_windowStart >= Thread::SECOND) {
+		shm().pipeline.maxLatency = m_maxLatency;
+		m_maxLatency = 0;
+		m_windowStart = t;
+	}
+}
+
+bool Pipeline::ready() {
+	return ShmVars::pipeline::enabled.get() && MPU9250::dataReady();
+}
+
+bool Pipeline::disabled() {
+	return !ShmVars::pipeline::enabled.get();
+}
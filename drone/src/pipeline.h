@@ -0,0 +1,30 @@
+#pragma once
+
+#include "shm.h"
+#include "controller.h"
+#include "thrust.h"
+
+// Runs read, fusion, control and thrust back to back once per IMU sample, as
+// soon as the data-ready interrupt fires, instead of on their own polled
+// timers. Enabled by pipeline.enabled in shm. Control and thrust then update
+// at the IMU's 200 Hz sample rate instead of 1 kHz, though the polled runs
+// between samples saw no new sensor data anyway.
+class Pipeline {
+	public:
+		Pipeline(Controller& controller, Thrust& thrust);
+		void operator()();
+
+		// Thread event: is a sample waiting for the pipeline?
+		static bool ready();
+
+		// Thread gate for the modules it runs: should they run on their own
+		// timers instead?
+		static bool disabled();
+
+	private:
+		Controller& m_controller;
+		Thrust& m_thrust;
+
+		unsigned long m_windowStart;
+		int m_maxLatency;
+};
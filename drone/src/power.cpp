@@ -7,7 +7,7 @@ void Power::readVoltage() {
 	float reading = analogRead(VOLTAGE_PIN);
 	float voltage = reading * 3.3 * VOLTAGE_FACTOR / 1023;
 
-	shm().power.voltage = voltage;
-	shm().power.low = voltage <= LOW_VOLTAGE;
-	shm().power.critical = voltage <= CRITICAL_VOLTAGE;
+	ShmVars::power::voltage.set(voltage);
+	ShmVars::power::low.set(voltage <= LOW_VOLTAGE);
+	ShmVars::power::critical.set(voltage <= CRITICAL_VOLTAGE);
 }
@@ -0,0 +1,51 @@
+#include <Arduino.h>
+#include <malloc.h>
+#include "log.h"
+#include "shm.h"
+#include "ram_report.h"
+
+// Section bounds from the Teensy linker script
+extern char _sdata, _edata, _sbss, _ebss, _estack;
+
+#ifdef COUNT_ALLOCATIONS
+static volatile unsigned long allocations = 0;
+
+extern "C" {
+	void* __real_malloc(size_t size);
+	void* __real_calloc(size_t count, size_t size);
+	void* __real_realloc(void* ptr, size_t size);
+
+	void* __wrap_malloc(size_t size) {
+		allocations = allocations + 1;
+		return __real_malloc(size);
+	}
+
+	void* __wrap_calloc(size_t count, size_t size) {
+		allocations = allocations + 1;
+		return __real_calloc(count, size);
+	}
+
+	void* __wrap_realloc(void* ptr, size_t size) {
+		allocations = allocations + 1;
+		return __real_realloc(ptr, size);
+	}
+}
+
+unsigned long heapAllocations() {
+	return allocations;
+}
+#endif
+
+void reportRam() {
+	int data = &_edata - &_sdata;
+	int bss = &_ebss - &_sbss;
+	int heap = mallinfo().uordblks;
+	int total = &_estack - &_sdata;
+
+	int shmVars = 0;
+	for (auto g : shm().groups()) shmVars += g->vars().size();
+
+	Log::info("RAM: %d data + %d bss + %d heap = %d of %d bytes",
+			data, bss, heap, data + bss + heap, total);
+	Log::info("shm: %d bytes of values in RAM, %d vars", (int)sizeof(Shm), shmVars);
+}
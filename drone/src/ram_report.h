@@ -0,0 +1,13 @@
+#pragma once
+
+// Logs how RAM is split between static data, the heap and shm, to compare
+// builds. Build with -DSHM_RAM_REPORT (the ramreport environment) to run it at
+// startup, once the threads are constructed.
+void reportRam();
+
+#ifdef COUNT_ALLOCATIONS
+// Heap allocations since startup, counted by wrapping malloc, calloc and
+// realloc at link time, which covers new. Build with -DCOUNT_ALLOCATIONS (the
+// alloccount environment) to log them for the flight loop every second.
+unsigned long heapAllocations();
+#endif
@@ -1,10 +1,13 @@
 #include <Arduino.h>
 #include <cmath>
+#include <cstring>
 #include <SPI.h>
 #include "log.h"
 #include "shm.h"
 #include "config.h"
 #include "remote.h"
+#include "journal.h"
+#include "history.h"
 
 Remote::Remote():
 	m_radioStream{
@@ -12,6 +15,8 @@ Remote::Remote():
 		RADIO_IRQ_PIN,
 		HAVE_RFM69HCW
 	},
+	m_radioLink{&m_radioStream, false, false},
+	m_serialLink{&Serial, false, false},
 	m_gotMsg{false},
 	m_lastMsgTime{0}
 {
@@ -29,16 +34,17 @@ void Remote::operator()() {
 	m_gotMsg = false;
 
 	int rssi = m_radioStream.rfm69().RSSI;
-	if (rssi != 0) shm().remote.rssi = rssi;
-	readStream(&m_radioStream);
-	readStream(&Serial);
+	if (rssi != 0) ShmVars::remote::rssi.set(rssi);
+	readStream(m_radioLink);
+	readStream(m_serialLink);
 
 	unsigned long t = millis();
 	if (m_gotMsg) m_lastMsgTime = t;
-	shm().remote.connected = t - m_lastMsgTime < REMOTE_TIMEOUT;
+	ShmVars::remote::connected.set(t - m_lastMsgTime < REMOTE_TIMEOUT);
 }
 
-void Remote::readStream(Stream* stream) {
+void Remote::readStream(Link& link) {
+	auto stream = link.stream;
 	while (stream->available()) {
 		uint8_t size = stream->read();
 		size_t bytesRead = 0;
@@ -56,6 +62,51 @@ void Remote::readStream(Stream* stream) {
 		if (!pb_decode_noinit(&pbUpdateStream, ShmMsg_fields, &msg)) {
 			Log::error("Failed to decode remote message: %s",
 					PB_GET_ERROR(&pbUpdateStream));
+			continue;
+		}
+
+		if (msg.which_value == ShmMsg_schemaHash_tag) {
+			handshake(link, msg.value.schemaHash);
+			continue;
+		}
+
+		// Its tags may mean other vars here
+		if (!link.verified) {
+			if (!link.warned) {
+				Log::warn("Ignoring remote messages until a matching schema handshake");
+				link.warned = true;
+			}
+			continue;
+		}
+
+		if (msg.which_value == ShmMsg_journal_tag) {
+			sendJournal(stream);
+			m_gotMsg = true;
+			continue;
+		}
+
+		if (msg.which_value == ShmMsg_historyRequest_tag) {
+			sendHistory(stream, msg.tag, msg.value.historyRequest);
+			m_gotMsg = true;
+			continue;
+		}
+
+		if (msg.which_value == ShmMsg_rangeRead_tag) {
+			sendRange(stream, msg.tag, msg.value.rangeRead);
+			m_gotMsg = true;
+			continue;
+		}
+
+		if (msg.which_value == ShmMsg_values_tag) {
+			applyValues(msg.tag, msg.value.values);
+			m_gotMsg = true;
+			continue;
+		}
+
+		if (msg.which_value == ShmMsg_batch_tag) {
+			applyBatch(msg.value.batch);
+			m_gotMsg = true;
+			continue;
 		}
 
 		auto shmVar = shm().varIfExists(msg.tag);
@@ -64,53 +115,209 @@ void Remote::readStream(Stream* stream) {
 			continue;
 		}
 
-		Shm::Var::Type msgVarType;
-		switch (msg.which_value) {
-			case ShmMsg_intValue_tag:
-				msgVarType = Shm::Var::Type::INT;
-				break;
-			case ShmMsg_floatValue_tag:
-				msgVarType = Shm::Var::Type::FLOAT;
-				break;
-			case ShmMsg_boolValue_tag:
-				msgVarType = Shm::Var::Type::BOOL;
-				break;
-			default:
-				sendVar(stream, shmVar);
-				m_gotMsg = true;
-				continue;
+		if (!msg.which_value) {
+			sendVar(stream, shmVar);
+			m_gotMsg = true;
+			continue;
 		}
 
-		auto shmVarType = shmVar->type();
-		if (msgVarType != shmVarType) {
-			Log::error("Remote var type mismatch: expected %s, got %s",
-					Shm::Var::typeString(shmVarType).c_str(),
-					Shm::Var::typeString(msgVarType).c_str());
-			continue;
+		if (!checkWrite(shmVar, msg)) continue;
+		applyWrite(shmVar, msg);
+
+		m_gotMsg = true;
+	}
+
+	stream->flush();
+}
+
+void Remote::applyBatch(const ShmBatch& batch) {
+	constexpr int maxWrites = sizeof(batch.writes) / sizeof(batch.writes[0]);
+	const Shm::Var* vars[maxWrites];
+	for (pb_size_t i = 0; i < batch.writes_count; i++) {
+		auto& write = batch.writes[i];
+		vars[i] = shm().varIfExists(write.tag);
+		if (!vars[i]) {
+			Log::error("Remote var tag not found: %d", write.tag);
 		}
+		if (!vars[i] || !checkWrite(vars[i], write)) {
+			Log::error("Discarding remote batch");
+			return;
+		}
+	}
+
+	// No other thread runs until we return, and subscribers only hear of
+	// the writes once they're all in, so everything sees all of it
+	shm().beginBatch();
+	for (pb_size_t i = 0; i < batch.writes_count; i++) {
+		applyWrite(vars[i], batch.writes[i]);
+	}
+	shm().endBatch();
+}
 
-		switch (shmVarType) {
+// Whether count vars from tag on exist and can go in ShmValues
+static bool checkRange(int tag, uint32_t count) {
+	// Compared this way round so a huge count can't overflow past the check
+	if (tag < 0 || tag > Shm::NUM_VARS || count > (uint32_t)(Shm::NUM_VARS - tag)) {
+		Log::error("Remote var range %d+%lu out of bounds", tag, (unsigned long)count);
+		return false;
+	}
+	for (int i = tag; i < tag + (int)count; i++) {
+		if (shm().var(i)->type() == Shm::Var::Type::STRING) {
+			Log::error("Remote var range %d+%lu includes a string", tag,
+					(unsigned long)count);
+			return false;
+		}
+	}
+	return true;
+}
+
+void Remote::applyValues(int tag, const ShmValues& values) {
+	if (!checkRange(tag, values.values_count)) {
+		Log::error("Discarding remote values");
+		return;
+	}
+
+	// Applied all at once, as for a batch
+	shm().beginBatch();
+	for (pb_size_t i = 0; i < values.values_count; i++) {
+		auto var = shm().var(tag + i);
+		uint32_t bits = values.values[i];
+		switch (var->type()) {
 			case Shm::Var::Type::INT:
-				shmVar->set((int)msg.value.intValue);
+				var->set((int)bits);
 				break;
 			case Shm::Var::Type::FLOAT:
-				shmVar->set(msg.value.floatValue);
+				{
+					float value;
+					memcpy(&value, &bits, sizeof(value));
+					var->set(value);
+				}
 				break;
 			case Shm::Var::Type::BOOL:
-				shmVar->set(msg.value.boolValue);
+				var->set(bits != 0);
 				break;
 			default:
-				Log::error("Unsupported remote var type");
-				continue;
+				break;
+		}
+	}
+	shm().endBatch();
+}
+
+void Remote::sendRange(Stream* stream, int tag, uint32_t count) {
+	if (!checkRange(tag, count)) return;
+
+	ShmMsg msg = ShmMsg_init_zero;
+	msg.which_value = ShmMsg_values_tag;
+	auto& values = msg.value.values;
+	constexpr int chunkSize = sizeof(values.values) / sizeof(values.values[0]);
+
+	for (int i = tag; i < tag + (int)count; i += chunkSize) {
+		msg.tag = i;
+		values.values_count = 0;
+		for (int j = i; j < i + chunkSize && j < tag + (int)count; j++) {
+			auto var = shm().var(j);
+			uint32_t bits = 0;
+			switch (var->type()) {
+				case Shm::Var::Type::INT:
+					bits = var->get<int>();
+					break;
+				case Shm::Var::Type::FLOAT:
+					{
+						float value = var->get<float>();
+						memcpy(&bits, &value, sizeof(bits));
+					}
+					break;
+				case Shm::Var::Type::BOOL:
+					bits = var->get<bool>();
+					break;
+				default:
+					break;
+			}
+			values.values[values.values_count++] = bits;
 		}
+		send(stream, msg);
+	}
+}
 
+void Remote::handshake(Link& link, uint32_t schemaHash) {
+	bool verified = schemaHash == Shm::SCHEMA_HASH;
+	if (!verified && !link.warned) {
+		Log::error("Remote schema hash %08lx doesn't match ours, %08lx; "
+				"regenerate shm and rebuild both", (unsigned long)schemaHash,
+				(unsigned long)Shm::SCHEMA_HASH);
+		link.warned = true;
+	} else if (verified && !link.verified) {
+		Log::info("Remote schema matches");
+		link.warned = false;
+	}
+
+	// The handheld forwards a bridged client's handshakes over the same
+	// radio link, so a stale client mustn't cut off the handheld's inputs
+	// once it has verified
+	if (verified) {
+		link.verified = true;
 		m_gotMsg = true;
 	}
 
-	stream->flush();
+	// Reply either way so the remote can check us too
+	ShmMsg reply = ShmMsg_init_zero;
+	reply.which_value = ShmMsg_schemaHash_tag;
+	reply.value.schemaHash = Shm::SCHEMA_HASH;
+	send(link.stream, reply);
+}
+
+// ShmWrite is numbered like ShmMsg, so writes of either check and apply alike
+static_assert(ShmWrite_intValue_tag == ShmMsg_intValue_tag
+		&& ShmWrite_floatValue_tag == ShmMsg_floatValue_tag
+		&& ShmWrite_boolValue_tag == ShmMsg_boolValue_tag,
+		"ShmWrite values must be numbered like ShmMsg");
+
+template <typename M>
+bool Remote::checkWrite(const Shm::Var* var, const M& msg) {
+	Shm::Var::Type msgVarType;
+	switch (msg.which_value) {
+		case ShmMsg_intValue_tag:
+			msgVarType = Shm::Var::Type::INT;
+			break;
+		case ShmMsg_floatValue_tag:
+			msgVarType = Shm::Var::Type::FLOAT;
+			break;
+		case ShmMsg_boolValue_tag:
+			msgVarType = Shm::Var::Type::BOOL;
+			break;
+		default:
+			Log::error("Remote write has no value");
+			return false;
+	}
+
+	auto shmVarType = var->type();
+	if (msgVarType != shmVarType) {
+		Log::error("Remote var type mismatch: expected %s, got %s",
+				Shm::Var::typeString(shmVarType).c_str(),
+				Shm::Var::typeString(msgVarType).c_str());
+		return false;
+	}
+	return true;
 }
 
-void Remote::sendVar(Stream* stream, Shm::Var* var) {
+template <typename M>
+void Remote::applyWrite(const Shm::Var* var, const M& msg) {
+	switch (var->type()) {
+		case Shm::Var::Type::INT:
+			var->set((int)msg.value.intValue);
+			break;
+		case Shm::Var::Type::FLOAT:
+			var->set(msg.value.floatValue);
+			break;
+		case Shm::Var::Type::BOOL:
+			var->set(msg.value.boolValue);
+			break;
+		default:
+			Log::error("Unsupported remote var type");
+	}
+}
+
+void Remote::sendVar(Stream* stream, const Shm::Var* var) {
 	ShmMsg msg;
 	msg.tag = var->tag();
 	switch (var->type()) {
@@ -131,6 +338,47 @@ void Remote::sendVar(Stream* stream, Shm::Var* var) {
 			return;
 	}
 
+	send(stream, msg);
+}
+
+// Empty once drained, or when built without the journal
+void Remote::sendJournal(Stream* stream) {
+	ShmMsg msg = ShmMsg_init_zero;
+	msg.which_value = ShmMsg_journal_tag;
+#ifdef SHM_JOURNAL
+	msg.value.journal.size = Journal::drain(msg.value.journal.bytes,
+			sizeof(msg.value.journal.bytes));
+#endif
+	send(stream, msg);
+}
+
+void Remote::sendHistory(Stream* stream, int tag, uint32_t since) {
+	ShmMsg msg = ShmMsg_init_zero;
+	msg.tag = tag;
+	msg.which_value = ShmMsg_history_tag;
+	auto& chunk = msg.value.history;
+	constexpr int chunkSize = sizeof(chunk.time) / sizeof(chunk.time[0]);
+
+	int closed = History::count(tag);
+	if (closed < 0) {
+		Log::error("Remote var %d has no history", tag);
+		closed = 0;
+	}
+
+	// One chunk per request, as each takes a few radio packets and the
+	// handheld can only buffer one at a time. Paging by time rather than
+	// index stays in place while buckets keep closing.
+	for (int i = 0; i < closed && chunk.time_count < chunkSize; i++) {
+		auto bucket = History::bucket(tag, i);
+		if (since && (long)(bucket.time - since) <= 0) continue;
+		chunk.time[chunk.time_count++] = bucket.time;
+		chunk.min[chunk.min_count++] = bucket.min;
+		chunk.max[chunk.max_count++] = bucket.max;
+	}
+	send(stream, msg);
+}
+
+void Remote::send(Stream* stream, const ShmMsg& msg) {
 	size_t encodedSize;
 	pb_get_encoded_size(&encodedSize, ShmMsg_fields, &msg);
 	constexpr int bufSize = sizeof(m_messageBuffer) / sizeof(m_messageBuffer[0]);
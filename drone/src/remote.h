@@ -14,11 +14,40 @@ class Remote {
 		void operator()();
 
 	private:
+		// A stream to a remote, which is only listened to after a handshake
+		// shows it was built from the same schema
+		struct Link {
+			Stream* stream;
+			bool verified;
+			bool warned; // About a mismatched schema, or ignoring it before it's verified
+		};
+
 		uint8_t m_messageBuffer[std::numeric_limits<uint8_t>::max()];
 		RadioStream m_radioStream;
+		Link m_radioLink, m_serialLink;
 		bool m_gotMsg;
 		unsigned long m_lastMsgTime;
 
-		void readStream(Stream* stream);
-		void sendVar(Stream* stream, Shm::Var* var);
+		void readStream(Link& link);
+		void handshake(Link& link, uint32_t schemaHash);
+		void applyBatch(const ShmBatch& batch);
+
+		// Values of count vars from tag on, packed into as few messages as
+		// fit them
+		void applyValues(int tag, const ShmValues& values);
+		void sendRange(Stream* stream, int tag, uint32_t count);
+
+		// Of a ShmMsg or ShmWrite, after checking it matches var's type
+		template <typename M>
+		static bool checkWrite(const Shm::Var* var, const M& msg);
+		template <typename M>
+		static void applyWrite(const Shm::Var* var, const M& msg);
+
+		void sendVar(Stream* stream, const Shm::Var* var);
+		void sendJournal(Stream* stream);
+
+		// One chunk of tag's history starting after the given time, or from
+		// the oldest for 0; empty when there's nothing after it
+		void sendHistory(Stream* stream, int tag, uint32_t since);
+		void send(Stream* stream, const ShmMsg& msg);
 };
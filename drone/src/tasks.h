@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include "shm.h"
+#include "thread.h"
+
+/* The drone's threads and their timing, in the order main.cpp runs them. The
+ * scheduler sim builds its default thread set from the same table, so what it
+ * checks is what flies. Periodic threads start at their threadRate default in
+ * shm.py.
+ */
+namespace Tasks {
+
+// Which threads run depends on whether pipeline.enabled is set
+enum class Mode {
+	ALWAYS,
+	PIPELINE, // Only while the pipeline is enabled
+	POLLED,   // Only while it's disabled, as the pipeline runs them instead
+};
+
+struct Spec {
+	const char* name;
+	Thread::Criticality criticality;
+
+	// For event tasks, the interval is how often the event fires, which the
+	// scheduler doesn't need but the sim models
+	unsigned long interval, deadline;
+	int priority;
+
+	// Released by the IMU's data-ready interrupt rather than a timer
+	bool event;
+
+	Mode mode;
+};
+
+enum {
+	PIPELINE,
+	THRUST,
+	IMU,
+	ALTIMETER,
+	REMOTE,
+	CONTROLLER,
+	DEADMAN,
+	POWER,
+	LED,
+	PERSIST,
+	HISTORY,
+	COUNT,
+};
+
+using C = Thread::Criticality;
+constexpr unsigned long SECOND = Thread::SECOND;
+
+// Default rates from shm.py
+constexpr Shm::Group_threadRate::Values RATES{};
+
+// initMPU9250 sets SMPLRT_DIV for 200 Hz samples
+constexpr unsigned long IMU_INTERVAL = SECOND / 200;
+
+// Prefer the controller over thrust so thrust writes its fresh output.
+// Deadman and LED share an interval too, so they're phased apart.
+constexpr Spec SPECS[COUNT] = {
+	{"pipeline", C::FLIGHT, IMU_INTERVAL, SECOND / 1000, 2, true, Mode::PIPELINE},
+	{"thrust", C::FLIGHT, SECOND / RATES.thrust, 0, 0, false, Mode::POLLED},
+	{"imu", C::FLIGHT, IMU_INTERVAL, SECOND / 1000, 0, true, Mode::POLLED},
+	{"altimeter", C::BEST_EFFORT, SECOND / RATES.altimeter, 0, 0, false, Mode::ALWAYS},
+	{"remote", C::NORMAL, SECOND / RATES.remote, 0, 0, false, Mode::ALWAYS},
+	{"controller", C::FLIGHT, SECOND / RATES.controller, 0, 1, false, Mode::POLLED},
+	{"deadman", C::FLIGHT, SECOND / RATES.deadman, 0, 0, false, Mode::ALWAYS},
+	{"power", C::NORMAL, SECOND / RATES.power, 0, 0, false, Mode::ALWAYS},
+	{"led", C::BEST_EFFORT, SECOND / RATES.led, 0, 0, false, Mode::ALWAYS},
+	{"persist", C::BEST_EFFORT, SECOND / RATES.persist, 0, 0, false, Mode::ALWAYS},
+	{"history", C::BEST_EFFORT, SECOND / RATES.history, 0, 0, false, Mode::ALWAYS},
+};
+
+// A thread for the task at index i running func, with its event and gate
+template <typename F>
+Task<F> make(size_t i, F func, bool (*event)() = nullptr, bool (*gate)() = nullptr) {
+	auto& spec = SPECS[i];
+	return {spec.name, func, spec.criticality, spec.event ? 0 : spec.interval,
+		spec.deadline, spec.priority, event, gate};
+}
+
+}
@@ -1,24 +1,420 @@
 #include <Arduino.h>
+#include "log.h"
+#include "shm.h"
 #include "thread.h"
 
-Thread::Thread(std::function<void()> func, unsigned long intervalMicros, int* tickTime):
-	m_func{func}, m_interval{intervalMicros}, m_tickTime{tickTime}, m_hasRun{false} {}
+#ifdef SCHEDULER_SIM
+#include "host/virtual_clock.h"
+#endif
 
-void Thread::operator()() {
-	auto t = micros();
-	if (!m_hasRun || t - m_lastTime >= m_interval) {
-		m_func();
-		if (m_tickTime) *m_tickTime = micros() - t;
-		m_hasRun = true;
-		m_lastTime = t;
+// Wraparound-safe time comparison
+static bool before(unsigned long a, unsigned long b) {
+	return (long)(a - b) < 0;
+}
+
+static int* threadVar(Shm::Group& group, const std::string& name) {
+	auto var = group.varIfExists(name);
+	return var ? var->ptr<int>() : nullptr;
+}
+
+Thread::Thread(const char* name, Criticality criticality,
+		unsigned long intervalMicros, unsigned long deadlineMicros,
+		int priority, bool (*event)(), bool (*gate)()):
+	m_name{name},
+	m_criticality{criticality},
+	m_interval{intervalMicros},
+	m_deadline{deadlineMicros ? deadlineMicros : intervalMicros},
+	m_deadlineIsInterval{!deadlineMicros},
+	m_rate{threadVar(shm().threadRate, name)},
+	m_appliedRate{0},
+	m_priority{priority},
+	m_event{event},
+	m_gate{gate},
+	m_stats{name},
+	m_release{micros()},
+	m_periodRelease{m_release},
+	m_released{false},
+	m_suspended{false},
+	m_held{false},
+	m_shed{false}
+{
+	// Only periodic threads have a rate, so they start at the one given
+	if (m_rate && (!m_interval || m_event)) m_rate = nullptr;
+	if (m_rate) {
+		m_appliedRate = (SECOND + m_interval / 2) / m_interval;
+		*m_rate = m_appliedRate;
+	}
+}
+
+const char* Thread::name() const {
+	return m_name;
+}
+
+Thread::Criticality Thread::criticality() const {
+	return m_criticality;
+}
+
+unsigned long Thread::releaseTime() const {
+	return m_release;
+}
+
+void Thread::shed(bool shed) {
+	m_shed = shed;
+}
+
+bool Thread::due(unsigned long time) {
+	if (m_gate) {
+		if (!m_gate()) {
+			m_held = true;
+			return false;
+		}
+		if (m_held) {
+			m_held = false;
+			m_release = m_periodRelease = time;
+		}
+	}
+	if (!m_event) return !before(time, m_release);
+
+	if (!m_released && m_event()) {
+		m_release = time;
+		m_released = true;
+	}
+	return m_released && !before(time, m_release);
+}
+
+void Thread::nextRelease(unsigned long& wake) const {
+	if (m_held || (m_event && !m_released)) return;
+	if (before(m_release, wake)) wake = m_release;
+}
+
+bool Thread::moreUrgentThan(const Thread& other) const {
+	if (background() != other.background()) return !background();
+
+	auto deadline = absoluteDeadline(), otherDeadline = other.absoluteDeadline();
+	if (deadline != otherDeadline) return before(deadline, otherDeadline);
+	return m_priority > other.m_priority;
+}
+
+void Thread::tune(Thread* threads[], size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		auto& thread = *threads[i];
+		if (!thread.m_rate) continue;
+
+		int rate = *thread.m_rate, oldRate = thread.m_appliedRate;
+		if (rate == oldRate) continue;
+
+		if (rate <= 0 || (unsigned long)rate > SECOND) {
+			Log::warn("Rejected thread %s rate %d Hz: out of range", thread.m_name, rate);
+			*thread.m_rate = oldRate;
+			continue;
+		}
+
+		unsigned long interval = SECOND / rate;
+		if (thread.m_stats.maxTime() >= interval) {
+			Log::warn("Rejected thread %s rate %d Hz: runs take up to %lu us",
+					thread.m_name, rate, thread.m_stats.maxTime());
+			*thread.m_rate = oldRate;
+			continue;
+		}
+
+		float load = (float)thread.m_stats.meanTime() / interval - thread.load();
+		for (size_t j = 0; j < count; j++) load += threads[j]->load();
+		if (load * 100 > MAX_LOAD) {
+			Log::warn("Rejected thread %s rate %d Hz: would load the CPU %d%%",
+					thread.m_name, rate, (int)(load * 100));
+			*thread.m_rate = oldRate;
+			continue;
+		}
+
+		thread.m_interval = interval;
+		thread.m_appliedRate = rate;
+		if (thread.m_deadlineIsInterval) thread.m_deadline = interval;
+	}
+}
+
+// Share of the CPU the thread takes: by its rate if it has one, since that may
+// have just changed, otherwise as measured
+float Thread::load() const {
+	if (m_rate) return (float)m_stats.meanTime() / m_interval;
+	return m_stats.utilization();
+}
+
+void Thread::phase(Thread* threads[], size_t count) {
+	auto start = micros();
+	for (size_t i = 0; i < count; i++) {
+		auto& thread = *threads[i];
+		thread.m_release = start;
+
+		if (thread.m_interval && !thread.m_event) {
+			// Count the slots needed by the busiest priority in this
+			// thread's interval, and find this thread's slot among its own
+			unsigned long slot = 0, slots = 1;
+			for (size_t j = 0; j < count; j++) {
+				auto& other = *threads[j];
+				if (other.m_interval != thread.m_interval || other.m_event) continue;
+
+				unsigned long samePriority = 0;
+				for (size_t k = 0; k < count; k++) {
+					if (threads[k]->m_interval == other.m_interval && !threads[k]->m_event
+							&& threads[k]->m_priority == other.m_priority) {
+						samePriority++;
+					}
+				}
+				if (samePriority > slots) slots = samePriority;
+				if (j < i && other.m_priority == thread.m_priority) slot++;
+			}
+			thread.m_release += thread.m_interval / slots * slot;
+		}
+
+		thread.m_periodRelease = thread.m_release;
+	}
+}
+
+bool Thread::finish(unsigned long start, Coroutine::Status status) {
+	auto end = micros();
+	bool missed = false;
+	m_stats.add(start, start - m_release, end - start);
+	if (!background() && before(absoluteDeadline(), end)) {
+		m_stats.miss(1);
+		missed = true;
+	}
+
+	// Resuming a coroutine is released like a new run, at its wake time
+	if (!status.finished()) {
+		m_release = status.wakeTime();
+		m_suspended = true;
+		return missed && !m_shed;
+	}
+
+	// Time spent suspended isn't falling behind, so carry on the period from
+	// the last resume
+	if (m_suspended) {
+		m_suspended = false;
+		m_periodRelease = m_release;
+	}
+
+	if (m_event) {
+		m_released = false;
+		return missed && !m_shed;
+	}
+
+	// Shed continuous threads wait out their deadline between runs
+	if (m_interval == 0) {
+		m_release = m_shed ? end + m_deadline : end;
+		return missed && !m_shed;
+	}
+
+	// Keep releases on the original period so they don't drift, but skip the
+	// ones we've already fallen a whole interval or more behind on
+	auto period = interval();
+	m_periodRelease += period;
+	if (!before(end, m_periodRelease + period)) {
+		unsigned long skipped = (end - m_periodRelease) / period;
+		m_periodRelease += skipped * period;
+		m_stats.miss(skipped);
+		missed = true;
 	}
+	m_release = m_periodRelease;
+	return missed && !m_shed;
 }
 
-FuncSet::FuncSet(std::initializer_list<std::function<void()>> funcs):
-	m_funcs{funcs} {}
+unsigned long Thread::interval() const {
+	return m_shed ? m_interval * SHED_SLOWDOWN : m_interval;
+}
+
+unsigned long Thread::deadline() const {
+	return m_shed ? m_deadline * SHED_SLOWDOWN : m_deadline;
+}
+
+bool Thread::background() const {
+	return m_deadline == 0;
+}
+
+unsigned long Thread::absoluteDeadline() const {
+	return m_release + deadline();
+}
+
+LoadShedder::LoadShedder():
+	m_level{(int)Thread::Criticality::BEST_EFFORT},
+	m_windowStart{micros()},
+	m_windowBusy{0},
+	m_windowMissed{false},
+	m_overloadedWindows{0},
+	m_clearWindows{0} {}
+
+bool LoadShedder::update(unsigned long time, unsigned long busy, bool missed) {
+	m_windowBusy += busy;
+	m_windowMissed |= missed;
+	auto elapsed = time - m_windowStart;
+	if (elapsed < WINDOW) return false;
+
+	int load = 100ull * m_windowBusy / elapsed;
+	if (m_windowMissed && load >= OVERLOAD_LOAD) {
+		m_overloadedWindows++;
+		m_clearWindows = 0;
+	} else if (load < RECOVERY_LOAD) {
+		m_clearWindows++;
+		m_overloadedWindows = 0;
+	} else {
+		m_overloadedWindows = m_clearWindows = 0;
+	}
+	m_windowStart = time;
+	m_windowBusy = 0;
+	m_windowMissed = false;
+	shm().scheduler.overloaded = m_overloadedWindows > 0;
+
+	int level = m_level;
+	if (m_overloadedWindows >= OVERLOAD_WINDOWS
+			&& level < (int)Thread::Criticality::FLIGHT) {
+		level++;
+		shm().scheduler.shedEvents++;
+		m_overloadedWindows = 0;
+	} else if (m_clearWindows >= RECOVERY_WINDOWS
+			&& level > (int)Thread::Criticality::BEST_EFFORT) {
+		level--;
+		m_clearWindows = 0;
+	}
+
+	if (level == m_level) return false;
+	m_level = level;
+	shm().scheduler.shedLevel = level;
+	return true;
+}
+
+bool LoadShedder::sheds(Thread::Criticality criticality) const {
+	return (int)criticality < m_level;
+}
+
+#ifdef __arm__
+static IntervalTimer wakeTimer;
+static void wakeUp() {}
+#endif
+
+Idle::Idle():
+	m_windowStart{micros()},
+	m_idleTime{0},
+	m_sleepStart{0},
+	m_until{0} {}
+
+bool Idle::arm(unsigned long now, unsigned long until) {
+	if (!before(now, until)) return false;
+	m_sleepStart = now;
+	m_until = until;
+
+#ifdef __arm__
+	// The timer interrupt wakes the core if nothing else does first. Without
+	// one, only an unrelated interrupt would, so don't sleep at all.
+	if (!wakeTimer.begin(wakeUp, until - now)) return false;
+#endif
+	return true;
+}
+
+void Idle::wait() {
+#ifdef __arm__
+	asm volatile("wfi");
+#elif defined(SCHEDULER_SIM)
+	VirtualClock::sleep(m_until);
+#endif
+}
+
+void Idle::finish() {
+#ifdef __arm__
+	wakeTimer.end();
+#endif
+	m_idleTime += micros() - m_sleepStart;
+	update(m_sleepStart);
+}
+
+void Idle::update(unsigned long time) {
+	auto elapsed = time - m_windowStart;
+	if (elapsed < WINDOW) return;
+
+	int idle = 100ull * m_idleTime / elapsed;
+	shm().scheduler.idle = idle;
+	shm().scheduler.load = 100 - idle;
+	m_windowStart = time;
+	m_idleTime = 0;
+}
+
+Thread::Stats::Stats(const std::string& name):
+	m_last{threadVar(shm().threadTime, name)},
+	m_min{threadVar(shm().threadTimeMin, name)},
+	m_max{threadVar(shm().threadTimeMax, name)},
+	m_mean{threadVar(shm().threadTimeMean, name)},
+	m_p99{threadVar(shm().threadTimeP99, name)},
+	m_jitter{threadVar(shm().threadJitter, name)},
+	m_misses{threadVar(shm().threadMisses, name)},
+	m_lastMeanTime{0},
+	m_lastMaxTime{0},
+	m_lastUtilization{0}
+{
+	reset(micros());
+}
+
+void Thread::Stats::add(unsigned long start, unsigned long lateness,
+		unsigned long execTime) {
+	if (m_last) *m_last = execTime;
+
+	if (execTime < m_minTime) m_minTime = execTime;
+	if (execTime > m_maxTime) m_maxTime = execTime;
+	if (lateness > m_maxLateness) m_maxLateness = lateness;
+	m_totalTime += execTime;
+	m_runs++;
+
+	int bucket = 0;
+	while (bucket < BUCKETS - 1 && execTime >> (bucket + 1)) bucket++;
+	m_histogram[bucket]++;
+
+	if (start - m_windowStart >= WINDOW) {
+		publish(start - m_windowStart);
+		reset(start);
+	}
+}
+
+void Thread::Stats::miss(int count) {
+	if (m_misses) *m_misses += count;
+}
+
+unsigned long Thread::Stats::meanTime() const {
+	return m_lastMeanTime;
+}
+
+unsigned long Thread::Stats::maxTime() const {
+	return m_lastMaxTime;
+}
+
+float Thread::Stats::utilization() const {
+	return m_lastUtilization;
+}
+
+void Thread::Stats::publish(unsigned long elapsed) {
+	m_lastMeanTime = m_totalTime / m_runs;
+	m_lastMaxTime = m_maxTime;
+	m_lastUtilization = (float)m_totalTime / elapsed;
+
+	if (m_min) *m_min = m_minTime;
+	if (m_max) *m_max = m_maxTime;
+	if (m_mean) *m_mean = m_lastMeanTime;
+	if (m_p99) *m_p99 = percentile(0.99);
+	if (m_jitter) *m_jitter = m_maxLateness;
+}
+
+void Thread::Stats::reset(unsigned long time) {
+	m_windowStart = time;
+	m_minTime = ~0ul;
+	m_maxTime = 0;
+	m_totalTime = 0;
+	m_maxLateness = 0;
+	m_runs = 0;
+	for (auto& count : m_histogram) count = 0;
+}
 
-void FuncSet::operator()() {
-	for (auto& f : m_funcs) {
-		f();
+// Upper bound of the bucket holding the percentile
+unsigned long Thread::Stats::percentile(float p) const {
+	unsigned long target = ceil(m_runs * p), runs = 0;
+	for (int bucket = 0; bucket < BUCKETS - 1; bucket++) {
+		runs += m_histogram[bucket];
+		if (runs >= target) return (2ul << bucket) - 1;
 	}
+	return m_maxTime;
 }
@@ -1,29 +1,362 @@
 #pragma once
 
-#include <functional>
-#include <vector>
+#include <Arduino.h>
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include "coroutine.h"
 
+// Scheduling state and statistics of a thread. The work itself is supplied by
+// Task, so the callable of every thread is known at compile time.
 class Thread {
 	public:
 		static constexpr int SECOND = 1e6;
 
-		Thread(std::function<void()> func, unsigned long intervalMicros, int* tickTime = nullptr);
-		void operator()();
+		// How much a thread matters to staying in the air. Under sustained
+		// overload the scheduler sheds the least critical threads first.
+		enum class Criticality {
+			BEST_EFFORT,
+			NORMAL,
+			FLIGHT, // Never shed
+		};
+
+		// Shed threads run this many times less often
+		static constexpr int SHED_SLOWDOWN = 4;
+
+		// Most of the CPU that retuned rates may use, in percent
+		static constexpr int MAX_LOAD = 90;
+
+		// Periodic threads are released every interval and should finish
+		// within their deadline of being released, which defaults to the
+		// interval. Threads without an interval are released again as soon as
+		// they finish; give them a deadline to bound how long they may wait,
+		// or leave it 0 to only run them when nothing else is due. Priority
+		// breaks ties between equal deadlines, higher first.
+		//
+		// Threads with an event are instead released whenever it returns true,
+		// and must make it return false again when they run.
+		//
+		// Threads with a gate are only released while it returns true, and
+		// start a fresh period when it opens again.
+		Thread(const char* name, Criticality criticality,
+				unsigned long intervalMicros, unsigned long deadlineMicros = 0,
+				int priority = 0, bool (*event)() = nullptr,
+				bool (*gate)() = nullptr);
+
+		const char* name() const;
+		Criticality criticality() const;
+
+		// When the current or next run was released
+		unsigned long releaseTime() const;
+
+		// Slow down or restore the thread
+		void shed(bool shed);
+
+		// Apply rates changed in the threadRate shm group, putting back any
+		// which a thread's runs wouldn't fit in or which would load the CPU
+		// beyond MAX_LOAD
+		static void tune(Thread* threads[], size_t count);
+
+		// Release threads together from now, spreading out the first releases
+		// of periodic threads which share an interval. Each gets a slot in
+		// its interval by its order among threads of the same priority, so
+		// those run evenly apart, while threads of different priorities
+		// share a release and run back to back in priority order.
+		static void phase(Thread* threads[], size_t count);
+
+		// Also notes the release time of event threads
+		bool due(unsigned long time);
+		bool moreUrgentThan(const Thread& other) const;
+
+		// Bring a wake time forward to the next release, if it's known
+		void nextRelease(unsigned long& wake) const;
+
+	protected:
+		// Account for a run which started at the given time and just ended,
+		// possibly suspending a coroutine. Returns whether the thread fell
+		// behind while not shed.
+		bool finish(unsigned long start, Coroutine::Status status = {});
 
 	private:
-		std::function<void()> m_func;
+		// Timing of a thread's runs, published to its entries in the thread*
+		// shm groups once per window
+		class Stats {
+			public:
+				static constexpr unsigned long WINDOW = SECOND;
+
+				Stats(const std::string& name);
+
+				// Lateness is how long after release the run started
+				void add(unsigned long start, unsigned long lateness,
+						unsigned long execTime);
+				void miss(int count);
+
+				// Over the last window
+				unsigned long meanTime() const;
+				unsigned long maxTime() const;
+				float utilization() const;
+
+			private:
+				// Power-of-two buckets of execution time in micros; the last
+				// bucket also holds everything longer
+				static constexpr int BUCKETS = 16;
+
+				int *m_last, *m_min, *m_max, *m_mean, *m_p99, *m_jitter, *m_misses;
+
+				unsigned long m_windowStart;
+				unsigned long m_minTime, m_maxTime, m_totalTime, m_maxLateness;
+				unsigned long m_runs;
+				unsigned long m_histogram[BUCKETS];
+				unsigned long m_lastMeanTime, m_lastMaxTime;
+				float m_lastUtilization;
+
+				void publish(unsigned long elapsed);
+				void reset(unsigned long time);
+				unsigned long percentile(float p) const;
+		};
+
+		const char* m_name;
+		Criticality m_criticality;
 		unsigned long m_interval;
-		int* m_tickTime;
+		unsigned long m_deadline;
+		bool m_deadlineIsInterval;
+		int* m_rate;
+		int m_appliedRate; // The rate m_interval came from, to put back
+		int m_priority;
+		bool (*m_event)();
+		bool (*m_gate)();
+		Stats m_stats;
 
-		unsigned long m_lastTime;
-		bool m_hasRun;
+		unsigned long m_release;
+		unsigned long m_periodRelease;
+		bool m_released;
+		bool m_suspended;
+		bool m_held;
+		bool m_shed;
+
+		unsigned long interval() const;
+		unsigned long deadline() const;
+		float load() const;
+		bool background() const;
+		unsigned long absoluteDeadline() const;
 };
 
-class FuncSet {
+// Detects sustained overload from deadline misses while the CPU is nearly
+// always busy, and chooses the criticality below which threads are shed,
+// restoring them once there's headroom again. Misses alone aren't overload:
+// a long run of a slow thread can make others miss while the CPU is mostly
+// idle, and shedding wouldn't help. Reports to the scheduler shm group.
+class LoadShedder {
 	public:
-		FuncSet(std::initializer_list<std::function<void()>> funcs);
-		void operator()();
-	
+		static constexpr unsigned long WINDOW = Thread::SECOND / 10;
+
+		// Share of a window spent running threads, in percent, above which
+		// misses count as overload, and below which a level may be restored
+		static constexpr int OVERLOAD_LOAD = Thread::MAX_LOAD;
+		static constexpr int RECOVERY_LOAD = 70;
+
+		// Consecutive overloaded windows before shedding another level, and
+		// recovered ones before restoring one
+		static constexpr int OVERLOAD_WINDOWS = 2;
+		static constexpr int RECOVERY_WINDOWS = 10;
+
+		LoadShedder();
+
+		// Note a run which started at the given time and took busy micros;
+		// returns whether the shed level changed
+		bool update(unsigned long time, unsigned long busy, bool missed);
+
+		bool sheds(Thread::Criticality criticality) const;
+
 	private:
-		std::vector<std::function<void()>> m_funcs;
+		int m_level;
+		unsigned long m_windowStart, m_windowBusy;
+		bool m_windowMissed;
+		int m_overloadedWindows, m_clearWindows;
+};
+
+// Sleeps the core while no thread is due, and reports the share of time
+// spent asleep and awake to the scheduler shm group
+class Idle {
+	public:
+		static constexpr unsigned long WINDOW = Thread::SECOND;
+
+		// Longest sleep when only waiting on events
+		static constexpr unsigned long MAX_SLEEP = Thread::SECOND / 100;
+
+		Idle();
+
+		// Sleeping takes three steps. Start the wake timer for the given time
+		// first, as Teensy's micros() and the timer setup both turn interrupts
+		// back on; returns false, and there's no sleep, if that time has
+		// already passed or no timer was free. Then, with
+		// interrupts disabled and any events checked again, wait for the
+		// timer or another interrupt. A pending interrupt still wakes the
+		// core while masked, so one raised after deciding to sleep isn't
+		// missed. Finish with interrupts enabled again.
+		bool arm(unsigned long now, unsigned long until);
+		void wait();
+		void finish();
+
+		// Publish once per window
+		void update(unsigned long time);
+
+	private:
+		unsigned long m_windowStart, m_idleTime;
+		unsigned long m_sleepStart, m_until;
+};
+
+// Calls a free function known at compile time
+template <void (*F)()>
+struct Func {
+	void operator()() { F(); }
+};
+
+// A thread running a callable of type F, held by value. Make F a reference
+// type to run an object owned elsewhere, or a Func to run a free function. The
+// callable may be a coroutine returning Coroutine::Status.
+template <typename F>
+class Task : public Thread {
+	public:
+		Task(const char* name, F func, Criticality criticality,
+				unsigned long intervalMicros, unsigned long deadlineMicros = 0,
+				int priority = 0, bool (*event)() = nullptr,
+				bool (*gate)() = nullptr):
+			Thread{name, criticality, intervalMicros, deadlineMicros, priority, event, gate},
+			m_func(func) {}
+
+		// Run if due
+		void operator()() {
+			auto t = micros();
+			if (due(t)) run(t);
+		}
+
+		// Run now, regardless of whether the task is due. Returns whether it
+		// fell behind.
+		bool run(unsigned long time) {
+			return run(time, std::is_void<decltype(m_func())>{});
+		}
+
+	private:
+		F m_func;
+
+		bool run(unsigned long time, std::true_type) {
+			m_func();
+			return finish(time);
+		}
+
+		bool run(unsigned long time, std::false_type) {
+			return finish(time, m_func());
+		}
+};
+
+// Earliest-deadline-first scheduler over a fixed set of tasks. Each call runs
+// the due task with the nearest deadline, so a slow low-rate task can only
+// delay a more urgent one by the length of a single run. Tasks are stored in
+// place and dispatched by index, so every task body is inlined into the
+// dispatch and nothing is allocated. Less critical tasks are slowed down
+// while the schedule is overloaded. Tasks are phased as described for
+// Thread::phase, in the order given. When nothing is due, the core sleeps
+// until the next release or an interrupt.
+template <typename... Tasks>
+class Scheduler {
+	public:
+		static constexpr size_t SIZE = sizeof...(Tasks);
+
+		Scheduler(Tasks... tasks): m_tasks{tasks...}, m_lastTune{micros()} {
+			bind<0>();
+			Thread::phase(m_threads, SIZE);
+		}
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		// How often to look for retuned rates
+		static constexpr unsigned long TUNE_INTERVAL = Thread::SECOND / 10;
+
+		Thread& thread(size_t i) {
+			return *m_threads[i];
+		}
+
+		void operator()() {
+			// Read the time before masking interrupts, since micros()
+			// enables them again on the way out
+			auto t = micros();
+			unsigned long wake;
+			if (!poll(t, wake)) sleep(t, wake);
+		}
+
+		// Run the most urgent due thread, if any, without sleeping when
+		// none is. Returns whether one ran.
+		bool poll() {
+			unsigned long wake;
+			return poll(micros(), wake);
+		}
+
+	private:
+		std::tuple<Tasks...> m_tasks;
+		Thread* m_threads[SIZE];
+		LoadShedder m_shedder;
+		Idle m_idle;
+		unsigned long m_lastTune;
+
+		// Otherwise sets wake to when one will be next
+		bool poll(unsigned long t, unsigned long& wake) {
+			size_t next = SIZE;
+			wake = t + Idle::MAX_SLEEP;
+			for (size_t i = 0; i < SIZE; i++) {
+				if (!m_threads[i]->due(t)) {
+					m_threads[i]->nextRelease(wake);
+				} else if (next == SIZE || m_threads[i]->moreUrgentThan(*m_threads[next])) {
+					next = i;
+				}
+			}
+			if (next == SIZE) return false;
+			m_idle.update(t);
+
+			bool missed = dispatch<0>(next, t);
+			if (m_shedder.update(t, micros() - t, missed)) {
+				for (auto thread : m_threads) {
+					thread->shed(m_shedder.sheds(thread->criticality()));
+				}
+			}
+
+			if (t - m_lastTune >= TUNE_INTERVAL) {
+				Thread::tune(m_threads, SIZE);
+				m_lastTune = t;
+			}
+			return true;
+		}
+
+		// Sleep until the given wake time unless an event turns up first
+		void sleep(unsigned long now, unsigned long wake) {
+			if (!m_idle.arm(now, wake)) return;
+			noInterrupts();
+			bool pending = false;
+			for (auto thread : m_threads) pending |= thread->due(now);
+			if (!pending) m_idle.wait();
+			interrupts();
+			m_idle.finish();
+		}
+
+		template <size_t I>
+		typename std::enable_if<(I < SIZE)>::type bind() {
+			m_threads[I] = &std::get<I>(m_tasks);
+			bind<I + 1>();
+		}
+
+		template <size_t I>
+		typename std::enable_if<(I == SIZE)>::type bind() {}
+
+		template <size_t I>
+		typename std::enable_if<(I < SIZE), bool>::type dispatch(size_t i, unsigned long time) {
+			if (i == I) return std::get<I>(m_tasks).run(time);
+			return dispatch<I + 1>(i, time);
+		}
+
+		template <size_t I>
+		typename std::enable_if<(I == SIZE), bool>::type dispatch(size_t, unsigned long) {
+			return false;
+		}
 };
@@ -1,9 +1,9 @@
 #include <Arduino.h>
 #include <cmath>
-#include <EEPROM.h>
 
 #include "shm.h"
 #include "log.h"
+#include "persist.h"
 #include "thrust.h"
 
 Thrust::Thruster::Thruster() {}
@@ -19,7 +19,8 @@ void Thrust::Thruster::operator()() {
 
 void Thrust::Thruster::operator()(float thrustValue) {
 	if (shm().switches.calibrateEscs) {
-		EEPROM.update(ESCS_CALIBRATED_ADDRESS, false);
+		ShmVars::calibration::escs.set(false);
+		Persist::save();
 		Log::fatal("Shutting down to calibrate");
 	}
 
@@ -39,28 +40,42 @@ void Thrust::Thruster::thrustNoKillCheck(float thrustValue) {
 }
 
 Thrust::Thrust() {
-	auto thrustersArray = shm().thrusters.array("t");
 	for (int i = 0; i < NUM_THRUSTERS; i++) {
-		m_thrusters[i] = {THRUSTER_PINS[i], thrustersArray[i]->ptr<float>()};
+		m_thrusters[i] = {THRUSTER_PINS[i], &shm().thrusters.t[i]};
 	}
 
-	if (!EEPROM.read(ESCS_CALIBRATED_ADDRESS)) {
-		EEPROM.update(ESCS_CALIBRATED_ADDRESS, true); // Write early in case we're interrupted
+	m_calibrating = !shm().calibration.escs;
+	if (m_calibrating) {
+		// Save early in case we're interrupted
+		ShmVars::calibration::escs.set(true);
+		Persist::save();
+	}
+
+	ShmVars::switches::softKill.subscribe(&softKilled, this);
+}
+
+void Thrust::softKilled(void* thrust, const Shm::Var* softKill) {
+	auto& self = *(Thrust*)thrust;
+	if (!softKill->get<bool>() || self.m_calibrating) return;
+	for (auto& t : self.m_thrusters) t.thrustNoKillCheck(0);
+}
 
-		bool lastSoftKill = shm().switches.softKill;
-		shm().switches.softKill = false;
+// Calibration waits seconds for the ESCs, so it's resumable rather than
+// blocking the other threads. Nothing else is thrust until it's done.
+Coroutine::Status Thrust::operator()() {
+	CO_BEGIN(m_calibration);
 
+	if (m_calibrating) {
 		Log::info("Calibrating thrusters...");
-		for (auto& t : m_thrusters) t(1);
-		delay(2500); // Wait for ESC to power on and register first input
-		for (auto& t : m_thrusters) t(0);
-		delay(500); // Wait for ESC to register second input
+		for (auto& t : m_thrusters) t.thrustNoKillCheck(1);
+		CO_SLEEP(m_calibration, 2500000); // Wait for ESC to power on and register first input
+		for (auto& t : m_thrusters) t.thrustNoKillCheck(0);
+		CO_SLEEP(m_calibration, 500000); // Wait for ESC to register second input
 		Log::info("Done calibrating thrusters");
-
-		shm().switches.softKill = lastSoftKill;
+		m_calibrating = false;
 	}
-}
 
-void Thrust::operator()() {
 	for (auto& t : m_thrusters) t();
+
+	CO_END(m_calibration);
 }
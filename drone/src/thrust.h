@@ -3,11 +3,14 @@
 #include <Servo.h>
 #include "shm.h"
 #include "config.h"
+#include "coroutine.h"
 
 class Thrust {
 	public:
 		Thrust();
-		void operator()();
+
+		// Finishes calibrating the ESCs first if they need it
+		Coroutine::Status operator()();
 
 	private:
 		class Thruster {
@@ -16,13 +19,17 @@ class Thrust {
 				Thruster(int pin, float* thrustValue);
 				void operator()(); // Thrust value from shm
 				void operator()(float thrustValue); // Thrust this value
+				void thrustNoKillCheck(float thrustValue);
 
 			private:
 				Servo m_esc;
 				float* m_thrustValue;
-
-				void thrustNoKillCheck(float thrustValue);
 		};
 
+		// Cuts thrust as soon as softKill is set, not at the next run
+		static void softKilled(void* thrust, const Shm::Var* softKill);
+
 		Thruster m_thrusters[NUM_THRUSTERS];
+		bool m_calibrating;
+		Coroutine m_calibration;
 };
@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <RFM69.h>
 #include <pb_encode.h>
+#include <pb_decode.h>
 #include "shm.pb.h"
 #include "shm.h"
 
@@ -26,7 +27,8 @@ constexpr bool INVERT_LEFT_X = false,
 		  INVERT_RIGHT_X = false,
 		  INVERT_RIGHT_Y = true;
 
-constexpr int INPUT_SEND_PERIOD = 100;
+constexpr int INPUT_SEND_PERIOD = 100,
+		  HANDSHAKE_PERIOD = 1000;
 
 constexpr float DEAD_ZONE = 0.05;
 constexpr int MAX_INPUT = 1023;
@@ -56,10 +58,19 @@ RadioStream radioStream(
 );
 
 uint8_t sendBuf[255]; // Max size that length byte can describe
+uint8_t recvBuf[32]; // Enough to check handshake replies
+bool inFrame = false; // Partway through a message from the drone
+uint8_t frameSize;
+size_t frameRead;
 size_t lastInputSend = millis();
+size_t lastHandshake = -HANDSHAKE_PERIOD; // Handshake straight away
 bool softKill = false;
 bool lastSoftKill = false;
 
+// Has the drone answered a handshake with our schema? Our tags may mean other
+// vars to it until then, so the LED stays on and no inputs are sent.
+bool schemaVerified = false;
+
 void readSoftKill() {
 	if (!digitalRead(SOFT_KILL_PIN)) {
 		softKill = true;
@@ -88,26 +99,39 @@ void writeRadioVar(const ShmMsg& v) {
 	radioStream.write(sendBuf, encodedSize);
 }
 
-ShmMsg desireVar(int shmTag, float v) {
-	ShmMsg msg;
-	msg.tag = shmTag;
-	msg.which_value = ShmMsg_floatValue_tag;
-	msg.value.floatValue = v;
-	return msg;
+ShmWrite desireVar(int shmTag, float v) {
+	ShmWrite write;
+	write.tag = shmTag;
+	write.which_value = ShmWrite_floatValue_tag;
+	write.value.floatValue = v;
+	return write;
 }
 
 void inputsToRadio() {
 	size_t t = millis();
-	if (t - lastInputSend < INPUT_SEND_PERIOD) return;
+	if (t - lastHandshake >= HANDSHAKE_PERIOD) {
+		ShmMsg handshake = ShmMsg_init_zero;
+		handshake.which_value = ShmMsg_schemaHash_tag;
+		handshake.value.schemaHash = SHM_SCHEMA_HASH;
+		writeRadioVar(handshake);
+		radioStream.flush();
+		lastHandshake = t;
+	}
+
+	if (t - lastInputSend < INPUT_SEND_PERIOD || !schemaVerified) return;
 	lastInputSend = t;
 
+	// One batch, so the drone never flies on sticks from different moments
+	ShmMsg msg = ShmMsg_init_zero;
+	msg.which_value = ShmMsg_batch_tag;
+	auto& batch = msg.value.batch;
+
 	// Always send sk if sk'd so we never miss it
 	if (softKill || softKill != lastSoftKill) {
-		ShmMsg softKillMsg;
-		softKillMsg.tag = SHM_SWITCHES_SOFTKILL_TAG;
-		softKillMsg.which_value = ShmMsg_boolValue_tag;
-		softKillMsg.value.boolValue = softKill;
-		writeRadioVar(softKillMsg);
+		auto& softKillWrite = batch.writes[batch.writes_count++];
+		softKillWrite.tag = SHM_SWITCHES_SOFTKILL_TAG;
+		softKillWrite.which_value = ShmWrite_boolValue_tag;
+		softKillWrite.value.boolValue = softKill;
 		lastSoftKill = softKill;
 	}
 
@@ -116,14 +140,50 @@ void inputsToRadio() {
 	float pitch = inputLerp(RIGHT_X_PIN, INVERT_RIGHT_X) * MAX_TILT;
 	float roll = inputLerp(RIGHT_Y_PIN, INVERT_RIGHT_Y) * MAX_TILT;
 
-	writeRadioVar(desireVar(SHM_DESIRES_FORCE_TAG, force));
-	writeRadioVar(desireVar(SHM_DESIRES_YAWVEL_TAG, yawVel));
-	writeRadioVar(desireVar(SHM_DESIRES_PITCH_TAG, pitch));
-	writeRadioVar(desireVar(SHM_DESIRES_ROLL_TAG, roll));
+	batch.writes[batch.writes_count++] = desireVar(SHM_DESIRES_FORCE_TAG, force);
+	batch.writes[batch.writes_count++] = desireVar(SHM_DESIRES_YAWVEL_TAG, yawVel);
+	batch.writes[batch.writes_count++] = desireVar(SHM_DESIRES_PITCH_TAG, pitch);
+	batch.writes[batch.writes_count++] = desireVar(SHM_DESIRES_ROLL_TAG, roll);
 
+	writeRadioVar(msg);
 	radioStream.flush();
 }
 
+// Checks a whole message from the drone for a handshake reply
+void checkHandshake(size_t size) {
+	ShmMsg msg = ShmMsg_init_zero;
+	auto istream = pb_istream_from_buffer(recvBuf, size);
+	if (pb_decode_noinit(&istream, ShmMsg_fields, &msg)
+			&& msg.which_value == ShmMsg_schemaHash_tag) {
+		schemaVerified = msg.value.schemaHash == SHM_SCHEMA_HASH;
+		digitalWrite(LED_PIN, !schemaVerified);
+	}
+}
+
+// Forwards messages from the drone to the client, checking its handshake
+// replies on the way. A message may be split across radio packets, so the
+// one in progress carries over between calls.
+void radioToSerial() {
+	while (radioStream.available()) {
+		uint8_t b = radioStream.read();
+		Serial.write(b);
+
+		if (!inFrame) {
+			frameSize = b;
+			frameRead = 0;
+			inFrame = frameSize > 0;
+			continue;
+		}
+
+		if (frameRead < sizeof(recvBuf)) recvBuf[frameRead] = b;
+		if (++frameRead < frameSize) continue;
+
+		inFrame = false;
+		if (frameSize <= sizeof(recvBuf)) checkHandshake(frameSize);
+	}
+	Serial.flush();
+}
+
 void mapStream(Stream* s1, Stream* s2) {
 	while (s1->available()) {
 		s2->write(s1->read());
@@ -136,6 +196,7 @@ void setup() {
 	pinMode(SOFT_KILL_PIN, INPUT_PULLUP);
 	pinMode(UN_SOFT_KILL_PIN, INPUT_PULLUP);
 	pinMode(LED_PIN, OUTPUT);
+	digitalWrite(LED_PIN, HIGH);
 
 	radioStream.begin(
 		RADIO_FREQUENCY,
@@ -150,6 +211,6 @@ void setup() {
 void loop() {
 	readSoftKill();
 	inputsToRadio();
-	mapStream(&radioStream, &Serial);
+	radioToSerial();
 	mapStream(&Serial, &radioStream);
 }
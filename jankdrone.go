@@ -4,9 +4,9 @@ import "github.com/alexozer/jankdrone/client"
 
 func main() {
 	out, in := make(chan []client.BoundVar), make(chan client.BoundVar)
-	status := make(chan string)
-	client.NewCli(in, out, status).Start()
-	client.NewSender(out, in, status).Start()
+	status, journal, history := make(chan string), make(chan bool), make(chan *client.Var)
+	client.NewCli(in, out, status, journal, history).Start()
+	client.NewSender(out, in, status, journal, history).Start()
 
 	select {}
 }
@@ -1,5 +1,7 @@
 #!/usr/bin/env python3
 
+import zlib
+
 from lib.pyratemp import pyratemp
 import shm
 
@@ -10,8 +12,58 @@ templates = [
     ('../client/shmdef.go.template', '../client/shmdef.go'),
 ]
 
+# Changes whenever a var is added, removed, renamed, retyped or retagged, so
+# builds from different schemas can tell they disagree
+def schema_hash(groups):
+    desc = ''
+    for g_name, g_vars in sorted(groups.items()):
+        for v_name, v_info in sorted(g_vars.items()):
+            desc += '{}.{}:{}:{}\n'.format(g_name, v_name,
+                    type(v_info.value).__name__, v_info.tag)
+    return zlib.crc32(desc.encode())
+
+# Seeded 32-bit FNV-1a, as hashPath() in shm.cpp.template
+def fnv1a(key, seed):
+    h = 2166136261 ^ seed
+    for c in key.encode():
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    return h
+
+# A minimal perfect hash of every "group.var" path, by hash and displace:
+# paths fall into buckets by their unseeded hash, then, fullest buckets first,
+# each bucket gets the first seed which sends all its paths to free slots.
+# Returns the seed of each bucket and the path and tag in each slot.
+def path_hash(groups, paths_per_bucket=2):
+    tags = {'{}.{}'.format(g_name, v_name): v_info.tag
+            for g_name, g_vars in groups.items() for v_name, v_info in g_vars.items()}
+    paths = sorted(tags)
+    n = len(paths)
+    n_buckets = (n + paths_per_bucket - 1) // paths_per_bucket
+    buckets = [[] for _ in range(n_buckets)]
+    for path in paths:
+        buckets[fnv1a(path, 0) % n_buckets].append(path)
+
+    seeds = [0] * n_buckets
+    slots = [None] * n
+    for b in sorted(range(n_buckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        seed = 1
+        while True:
+            taken = [fnv1a(path, seed) % n for path in buckets[b]]
+            if len(set(taken)) == len(taken) and all(slots[t] is None for t in taken):
+                break
+            seed += 1
+            if seed > 0xffff:
+                raise Exception('No perfect hash seed for ' + ', '.join(buckets[b]))
+        seeds[b] = seed
+        for path, t in zip(buckets[b], taken):
+            slots[t] = path
+    return seeds, [(path, tags[path]) for path in slots]
+
 if __name__ == '__main__':
     for t in templates:
         pt = pyratemp.Template(filename=t[0])
         with open(t[1], 'w') as out:
-            out.write(pt(shm=shm.shm))
+            out.write(pt(shm=shm.shm, snapshot=shm.snapshot_groups,
+                schema_hash=schema_hash(shm.shm), path_hash=path_hash(shm.shm)))
@@ -1,6 +1,12 @@
 from collections import namedtuple
 
-Var = namedtuple('Var', ['value', 'tag'])
+Var = namedtuple('Var', ['value', 'tag', 'array', 'index', 'length', 'persistent',
+    'historied'])
+
+# An array of length variables sharing a default value. Its elements are
+# variables named by the array and their index, like t0, with consecutive
+# tags, and the drone packs them into a C array.
+Array = namedtuple('Array', ['value', 'length'])
 
 # Shm (shared memory) is a lightweight database of primitive datatypes designed
 # for message passing between code modules, devices, and users. Shm groups have
@@ -10,7 +16,33 @@ Var = namedtuple('Var', ['value', 'tag'])
 # The drone uses a right-handed coordinate system with X pointing right, Y
 # pointing forward, and Z pointing up.
 
+# The drone's threads, as in tasks.h, each with its default rate in Hz if it's
+# periodic, which tasks.h takes from threadRate. Every thread has a var in
+# each of the thread groups below.
+threads = {
+    'pipeline': None,
+    'thrust': 1000,
+    'imu': None,
+    'altimeter': 15,
+    'remote': 100,
+    'controller': 1000,
+    'deadman': 30,
+    'power': 10,
+    'led': 30,
+    'persist': 1,
+    'history': 200,
+}
+
 untagged_shm = {
+    # Whether the ESCs and IMU have been calibrated, and the extremes of each
+    # magnetometer axis found by calibrating, in raw counts
+    'calibration': {
+        'escs': False,
+        'imu': False,
+        'magMax': Array(0, 3),
+        'magMin': Array(0, 3),
+    },
+
     'switches': {
         'softKill': True,
         'calibrateEscs': False,
@@ -18,18 +50,18 @@ untagged_shm = {
         'calibrateAltimeter': False,
     },
 
+    # Whether builds with the journal record shm writes in it; see journal.h
+    # for which writes and how far back it reaches, about 0.2 s in flight.
+    # Soft killing or draining it stops recording, so a crash stays in it.
+    'journal': {
+        'recording': True,
+    },
+
     # Specified from 0 degrees and moving counterclockwise
-    # More vars may be added as necessary to satisfy thruster count constant,
-    # and extra vars are okay
+    # The drone checks at compile time there's one for each of NUM_THRUSTERS,
+    # and extras are okay
     'thrusters': {
-        't0': 0.0,
-        't1': 0.0,
-        't2': 0.0,
-        't3': 0.0,
-        't4': 0.0,
-        't5': 0.0,
-        't6': 0.0,
-        't7': 0.0,
+        't': Array(0.0, 8),
     },
 
     'desires': {
@@ -51,6 +83,18 @@ untagged_shm = {
         'enabled': True,
     },
 
+    # Read, fuse, control and thrust once per IMU sample, instead of on
+    # separate timers; opt-in until it's flown more. The controller and
+    # thrust then run at the IMU's 200 Hz rather than their 1 kHz threadRate,
+    # though each run acts on a fresh sample. Latencies are in
+    # microseconds from the IMU's data-ready interrupt to thrust being written,
+    # for the last sample and the worst over the last second.
+    'pipeline': {
+        'enabled': False,
+        'latency': 0,
+        'maxLatency': 0,
+    },
+
     'controllerOut': {
         'z': 0.0,
         'yaw': 0.0,
@@ -96,15 +140,39 @@ untagged_shm = {
         'rssi': 0,
     },
 
-    'threadTime': {
-        'thrust': 0,
-        'remote': 0,
-        'imu': 0,
-        'controller': 0,
-        'led': 0,
-        'altimeter': 0,
+    # Load shedding: overloaded while deadlines are missed with the CPU nearly
+    # always busy. Threads less critical than shedLevel (0 best effort, 1
+    # normal, 2 flight) run slower, and shedEvents counts each time another
+    # level is shed. Idle and load are the percentages of the last second
+    # spent asleep and running threads.
+    'scheduler': {
+        'idle': 0,
+        'load': 0,
+        'overloaded': False,
+        'shedLevel': 0,
+        'shedEvents': 0,
     },
 
+    # Rates of periodic threads in Hz, which can be changed while running.
+    # Rates a thread can't keep up with are put back.
+    'threadRate': {name: rate for name, rate in threads.items() if rate},
+
+    # Thread execution times in microseconds: the last run, then the min,
+    # max, mean and 99th percentile over the last second
+    'threadTime': dict.fromkeys(threads, 0),
+    'threadTimeMin': dict.fromkeys(threads, 0),
+    'threadTimeMax': dict.fromkeys(threads, 0),
+    'threadTimeMean': dict.fromkeys(threads, 0),
+
+    # Upper bound of the power-of-two bucket holding the 99th percentile
+    'threadTimeP99': dict.fromkeys(threads, 0),
+
+    # Longest delay between release and start over the last second
+    'threadJitter': dict.fromkeys(threads, 0),
+
+    # Runs finished after their deadline, or skipped for falling behind
+    'threadMisses': dict.fromkeys(threads, 0),
+
     'zConf': {
         'enabled': False,
         'p': 0.001,
@@ -134,14 +202,52 @@ untagged_shm = {
     },
 }
 
+# Vars kept in EEPROM across reboots, as whole groups or group.var, where var
+# may be an array
+persistent = {
+    'calibration',
+    'zConf',
+    'yawConf',
+    'pitchConf',
+    'rollConf',
+    'deadman.maxTilt',
+    'led.brightness',
+}
+
+# Int and float vars whose last few seconds the drone keeps, sampled and
+# decimated to their min and max, as whole groups or group.var; see history.h
+historied = {
+    'placement.z',
+    'placement.yaw',
+    'placement.pitch',
+    'placement.roll',
+    'controllerOut',
+    'power.voltage',
+}
+
+# Groups whose writers publish several variables at once, which readers can
+# copy with snapshot() and get all of a write or none of it
+snapshot_groups = {
+    'placement',
+}
+
+# Groups and vars are in tag order
 def tag(untagged):
     current_tag = 0
     tagged_groups = {}
     for g_name, g_vars in sorted(untagged.items()):
         tagged_vars = {}
         for v_name, v_value in sorted(g_vars.items()):
-            tagged_vars[v_name] = Var(v_value, current_tag)
-            current_tag += 1
+            p = g_name in persistent or g_name + '.' + v_name in persistent
+            h = g_name in historied or g_name + '.' + v_name in historied
+            if isinstance(v_value, Array):
+                for i in range(v_value.length):
+                    tagged_vars[v_name + str(i)] = Var(v_value.value,
+                            current_tag, v_name, i, v_value.length, p, h)
+                    current_tag += 1
+            else:
+                tagged_vars[v_name] = Var(v_value, current_tag, None, 0, 1, p, h)
+                current_tag += 1
 
         tagged_groups[g_name] = tagged_vars
 